@@ -0,0 +1,1173 @@
+//
+// Copyright 2010-2016 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License").
+// You may not use this file except in compliance with the License.
+// A copy of the License is located at
+//
+// http://aws.amazon.com/apache2.0
+//
+// or in the "license" file accompanying this file. This file is distributed
+// on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied. See the License for the specific language governing
+// permissions and limitations under the License.
+//
+
+#if AWS_TEST_COGNITO_DATASET
+
+#import <UIKit/UIKit.h>
+#import <XCTest/XCTest.h>
+#import <AWSCore/AWSCore.h>
+#import <AWSCore/AWSReachability.h>
+#import "AWSCognito.h"
+#import "AWSCognitoSQLiteManager.h"
+#import "AWSCognitoDataset_Internal.h"
+#import "AWSCognitoConstants.h"
+
+NSString *const AWSCognitoDatasetTestsIdentityId = @"us-east-1:00000000-0000-0000-0000-000000000000";
+NSString *const AWSCognitoDatasetTestsDatasetName = @"pagedDataset";
+NSUInteger const AWSCognitoDatasetTestsRecordCount = 1024;
+
+#pragma mark - Local CognitoSync mock
+
+@interface AWSCognitoDatasetTestsCredentialsProvider : AWSCognitoCredentialsProvider
+@end
+
+static NSUInteger AWSCognitoDatasetTestsIdentityRequests = 0;
+
+@implementation AWSCognitoDatasetTestsCredentialsProvider
+
+- (NSString *)identityId {
+    return AWSCognitoDatasetTestsIdentityId;
+}
+
+- (AWSTask *)getIdentityId {
+    @synchronized([AWSCognitoDatasetTestsCredentialsProvider class]) {
+        AWSCognitoDatasetTestsIdentityRequests++;
+    }
+    return [AWSTask taskWithResult:AWSCognitoDatasetTestsIdentityId];
+}
+
+@end
+
+/**
+ * Serves a fixed set of remote records from memory, paging them with a numeric nextToken.
+ */
+@interface AWSCognitoDatasetTestsSyncService : AWSCognitoSync
+
+@property (nonatomic, strong) NSArray *remoteRecords;
+@property (nonatomic, strong) AWSCognitoSQLiteManager *sqliteManager;
+@property (nonatomic, strong) NSMutableArray *listRequests;
+@property (nonatomic, strong) NSMutableArray *updateRequests;
+// the name of every operation called, in order
+@property (nonatomic, strong) NSMutableArray *calls;
+@property (nonatomic, strong) NSArray *remoteDatasets;
+@property (nonatomic, strong) NSMutableArray *localRecordCounts;
+@property (nonatomic, assign) NSUInteger largestPage;
+@property (nonatomic, assign) NSInteger failAtRequest;
+// handed out with every page; requests carrying any other session token are rejected
+@property (nonatomic, strong) NSString *sessionToken;
+// the UpdateRecords call, counting from 0, that is rejected with a resource conflict
+@property (nonatomic, assign) NSInteger conflictAtUpdate;
+// key and value bytes of every patch sent, accepted or not
+@property (nonatomic, assign) NSUInteger patchBytesSent;
+// milliseconds each request takes to answer
+@property (nonatomic, assign) int latency;
+// ListRecords calls waiting on latency
+@property (nonatomic, assign) NSUInteger activeRequests;
+@property (nonatomic, assign) NSUInteger peakActiveRequests;
+
+@end
+
+@implementation AWSCognitoDatasetTestsSyncService
+
+- (AWSTask *)listRecords:(AWSCognitoSyncListRecordsRequest *)request {
+    NSInteger requestIndex;
+    @synchronized(self) {
+        [self.listRequests addObject:request];
+        [self.calls addObject:@"ListRecords"];
+        // how much of the dataset had been written locally when this page was requested
+        [self.localRecordCounts addObject:[self.sqliteManager numRecords:request.datasetName]];
+        requestIndex = (NSInteger)[self.listRequests count] - 1;
+    }
+
+    if (requestIndex == self.failAtRequest) {
+        return [AWSTask taskWithError:[NSError errorWithDomain:@"AWSCognitoDatasetTests" code:1 userInfo:nil]];
+    }
+    if (request.syncSessionToken != nil && ![request.syncSessionToken isEqualToString:self.sessionToken]) {
+        return [AWSTask taskWithError:[NSError errorWithDomain:AWSCognitoSyncErrorDomain code:AWSCognitoSyncErrorInvalidParameter userInfo:nil]];
+    }
+
+    NSUInteger count = [self.remoteRecords count];
+    NSUInteger start = (NSUInteger)[request.nextToken integerValue];
+    NSUInteger pageSize = request.maxResults ? [request.maxResults unsignedIntegerValue] : count;
+    NSUInteger end = MIN(start + pageSize, count);
+    self.largestPage = MAX(self.largestPage, end - start);
+
+    AWSCognitoSyncListRecordsResponse *response = [AWSCognitoSyncListRecordsResponse new];
+    response.records = [self.remoteRecords subarrayWithRange:NSMakeRange(start, end - start)];
+    response.datasetExists = @YES;
+    response.datasetDeletedAfterRequestedSyncCount = @NO;
+    response.datasetSyncCount = [NSNumber numberWithUnsignedInteger:count];
+    response.lastModifiedBy = @"remote";
+    response.syncSessionToken = self.sessionToken;
+    response.nextToken = end < count ? [NSString stringWithFormat:@"%lu", (unsigned long)end] : nil;
+    if (self.latency > 0) {
+        @synchronized(self) {
+            self.activeRequests++;
+            self.peakActiveRequests = MAX(self.peakActiveRequests, self.activeRequests);
+        }
+        return [[AWSTask taskWithDelay:self.latency] continueWithBlock:^id(AWSTask *task) {
+            @synchronized(self) {
+                self.activeRequests--;
+            }
+            return response;
+        }];
+    }
+    return [AWSTask taskWithResult:response];
+}
+
+- (AWSTask *)listDatasets:(AWSCognitoSyncListDatasetsRequest *)request {
+    @synchronized(self) {
+        [self.calls addObject:@"ListDatasets"];
+    }
+    AWSCognitoSyncListDatasetsResponse *response = [AWSCognitoSyncListDatasetsResponse new];
+    response.datasets = self.remoteDatasets;
+    response.count = [NSNumber numberWithUnsignedInteger:[self.remoteDatasets count]];
+    return [AWSTask taskWithResult:response];
+}
+
+- (AWSTask *)updateRecords:(AWSCognitoSyncUpdateRecordsRequest *)request {
+    NSInteger requestIndex;
+    @synchronized(self) {
+        [self.updateRequests addObject:request];
+        [self.calls addObject:@"UpdateRecords"];
+        for (AWSCognitoSyncRecordPatch *patch in request.recordPatches) {
+            self.patchBytesSent += [patch.key lengthOfBytesUsingEncoding:NSUTF8StringEncoding] + [patch.value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        }
+        requestIndex = (NSInteger)[self.updateRequests count] - 1;
+    }
+
+    if (requestIndex == self.conflictAtUpdate) {
+        return [AWSTask taskWithError:[NSError errorWithDomain:AWSCognitoSyncErrorDomain code:AWSCognitoSyncErrorResourceConflict userInfo:nil]];
+    }
+
+    // accept every patch
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:[request.recordPatches count]];
+    for (AWSCognitoSyncRecordPatch *patch in request.recordPatches) {
+        AWSCognitoSyncRecord *record = [AWSCognitoSyncRecord new];
+        record.key = patch.key;
+        record.value = patch.value;
+        record.syncCount = [NSNumber numberWithLongLong:[patch.syncCount longLongValue] + 1];
+        record.lastModifiedBy = @"tester";
+        record.lastModifiedDate = [NSDate date];
+        [records addObject:record];
+    }
+    AWSCognitoSyncUpdateRecordsResponse *response = [AWSCognitoSyncUpdateRecordsResponse new];
+    response.records = records;
+    return [AWSTask taskWithResult:response];
+}
+
+@end
+
+/**
+ * One remote dataset shared by every local dataset that talks to it, standing in for many devices
+ * writing to the same dataset. An update is rejected with a conflict if another update was accepted
+ * after listRecords handed out its session token.
+ */
+@interface AWSCognitoDatasetTestsContendedService : AWSCognitoSync
+
+@property (nonatomic, strong) NSMutableDictionary *records;
+@property (nonatomic, assign) long long syncCount;
+@property (nonatomic, assign) NSUInteger conflicts;
+// milliseconds each request takes to answer
+@property (nonatomic, assign) int latency;
+
+@end
+
+@implementation AWSCognitoDatasetTestsContendedService
+
+- (AWSTask *)listRecords:(AWSCognitoSyncListRecordsRequest *)request {
+    AWSCognitoSyncListRecordsResponse *response = [AWSCognitoSyncListRecordsResponse new];
+    @synchronized(self) {
+        NSMutableArray *records = [NSMutableArray new];
+        for (AWSCognitoSyncRecord *record in [self.records allValues]) {
+            if ([record.syncCount longLongValue] > [request.lastSyncCount longLongValue]) {
+                [records addObject:record];
+            }
+        }
+        response.records = records;
+        response.datasetExists = @YES;
+        response.datasetDeletedAfterRequestedSyncCount = @NO;
+        response.datasetSyncCount = [NSNumber numberWithLongLong:self.syncCount];
+        response.lastModifiedBy = @"remote";
+        response.syncSessionToken = [NSString stringWithFormat:@"%lld", self.syncCount];
+    }
+    return [[AWSTask taskWithDelay:self.latency] continueWithBlock:^id(AWSTask *task) {
+        return response;
+    }];
+}
+
+- (AWSTask *)updateRecords:(AWSCognitoSyncUpdateRecordsRequest *)request {
+    return [[AWSTask taskWithDelay:self.latency] continueWithBlock:^id(AWSTask *task) {
+        @synchronized(self) {
+            if ([request.syncSessionToken longLongValue] != self.syncCount) {
+                self.conflicts++;
+                return [AWSTask taskWithError:[NSError errorWithDomain:AWSCognitoSyncErrorDomain code:AWSCognitoSyncErrorResourceConflict userInfo:nil]];
+            }
+            self.syncCount++;
+            NSMutableArray *records = [NSMutableArray arrayWithCapacity:[request.recordPatches count]];
+            for (AWSCognitoSyncRecordPatch *patch in request.recordPatches) {
+                AWSCognitoSyncRecord *record = [AWSCognitoSyncRecord new];
+                record.key = patch.key;
+                record.value = patch.value;
+                record.syncCount = [NSNumber numberWithLongLong:self.syncCount];
+                record.lastModifiedBy = request.datasetName;
+                record.lastModifiedDate = [NSDate date];
+                self.records[patch.key] = record;
+                [records addObject:record];
+            }
+            AWSCognitoSyncUpdateRecordsResponse *response = [AWSCognitoSyncUpdateRecordsResponse new];
+            response.records = records;
+            return response;
+        }
+    }];
+}
+
+@end
+
+/**
+ * Runs scheduled blocks only when the test advances it.
+ */
+@interface AWSCognitoDatasetTestsClock : NSObject
+
+@property (nonatomic, assign) NSTimeInterval now;
+@property (nonatomic, strong) NSMutableArray *timers;
+
+@end
+
+@implementation AWSCognitoDatasetTestsClock
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _timers = [NSMutableArray new];
+    }
+    return self;
+}
+
+- (void)schedule:(dispatch_block_t)block after:(NSTimeInterval)delay {
+    @synchronized(self) {
+        [self.timers addObject:@[[NSNumber numberWithDouble:self.now + delay], block]];
+    }
+}
+
+- (void)advance:(NSTimeInterval)interval {
+    @synchronized(self) {
+        self.now += interval;
+    }
+    while (YES) {
+        NSArray *due = nil;
+        @synchronized(self) {
+            for (NSArray *timer in self.timers) {
+                if ([timer[0] doubleValue] <= self.now && (due == nil || [timer[0] doubleValue] < [due[0] doubleValue])) {
+                    due = timer;
+                }
+            }
+            [self.timers removeObject:due];
+        }
+        if (due == nil) {
+            return;
+        }
+        ((dispatch_block_t)due[1])();
+    }
+}
+
+@end
+
+@interface AWSCognitoDatasetTestsReachability : AWSReachability
+
+@property (nonatomic, assign) BOOL offline;
+@property (nonatomic, assign) BOOL notifierRunning;
+
+@end
+
+@implementation AWSCognitoDatasetTestsReachability
+
+- (AWSNetworkStatus)currentReachabilityStatus {
+    return self.offline ? AWSNetworkStatusNotReachable : AWSNetworkStatusReachableViaWiFi;
+}
+
+- (BOOL)startNotifier {
+    self.notifierRunning = YES;
+    return YES;
+}
+
+- (void)stopNotifier {
+    self.notifierRunning = NO;
+}
+
+@end
+
+@interface AWSCognito()
+
+@property (nonatomic, strong) AWSCognitoSQLiteManager *sqliteManager;
+@property (nonatomic, strong) AWSCognitoSync *cognitoService;
+@property (nonatomic, strong) AWSTask *scheduledFlushTask;
+@property (nonatomic, strong) AWSReachability *reachability;
+@property (nonatomic, copy) void (^schedulerDispatchAfter)(NSTimeInterval delay, dispatch_block_t block);
+
+@end
+
+#pragma mark - Tests
+
+@interface AWSCognitoDatasetTests : XCTestCase
+
+@property (nonatomic, strong) AWSCognitoSQLiteManager *manager;
+@property (nonatomic, strong) AWSCognitoDatasetTestsSyncService *service;
+@property (nonatomic, strong) AWSServiceConfiguration *configuration;
+
+@end
+
+@implementation AWSCognitoDatasetTests
+
+- (void)setUp {
+    [super setUp];
+
+    AWSCognitoDatasetTestsCredentialsProvider *provider = [[AWSCognitoDatasetTestsCredentialsProvider alloc] initWithRegionType:AWSRegionUSEast1
+                                                                                                                  identityPoolId:@"us-east-1:11111111-1111-1111-1111-111111111111"];
+    AWSServiceConfiguration *configuration = [[AWSServiceConfiguration alloc] initWithRegion:AWSRegionUSEast1 credentialsProvider:provider];
+    self.configuration = configuration;
+
+    self.manager = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:AWSCognitoDatasetTestsIdentityId deviceId:@"tester"];
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    self.service = [[AWSCognitoDatasetTestsSyncService alloc] initWithConfiguration:configuration];
+#pragma clang diagnostic pop
+    self.service.sqliteManager = self.manager;
+    self.service.listRequests = [NSMutableArray new];
+    self.service.updateRequests = [NSMutableArray new];
+    self.service.calls = [NSMutableArray new];
+    self.service.localRecordCounts = [NSMutableArray new];
+    self.service.failAtRequest = -1;
+    self.service.sessionToken = @"session";
+    self.service.conflictAtUpdate = -1;
+
+    // 1024 records of ~1KB each, roughly the largest dataset the service allows
+    NSString *value = [@"" stringByPaddingToLength:1000 withString:@"v" startingAtIndex:0];
+    NSMutableArray *remoteRecords = [NSMutableArray arrayWithCapacity:AWSCognitoDatasetTestsRecordCount];
+    for (NSUInteger i = 0; i < AWSCognitoDatasetTestsRecordCount; i++) {
+        AWSCognitoSyncRecord *record = [AWSCognitoSyncRecord new];
+        record.key = [NSString stringWithFormat:@"key%lu", (unsigned long)i];
+        record.value = value;
+        record.syncCount = [NSNumber numberWithUnsignedInteger:i + 1];
+        record.lastModifiedBy = @"remote";
+        record.lastModifiedDate = [NSDate date];
+        [remoteRecords addObject:record];
+    }
+    self.service.remoteRecords = remoteRecords;
+}
+
+- (void)tearDown {
+    [self.manager deleteSQLiteDatabase];
+    [AWSCognito setSynchronizeRetryBudget:AWSCognitoSynchronizeRetryBudget];
+    [super tearDown];
+}
+
+- (AWSCognitoDataset *)openDatasetWithPageSize:(uint32_t)pageSize {
+    AWSCognitoDataset *dataset = [[AWSCognitoDataset alloc] initWithDatasetName:AWSCognitoDatasetTestsDatasetName
+                                                                  sqliteManager:self.manager
+                                                                 cognitoService:self.service];
+    dataset.synchronizeRetries = 1;
+    dataset.synchronizePageSize = pageSize;
+    return dataset;
+}
+
+- (void)testSynchronizePullsInPages {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:100];
+
+    AWSTask *task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+
+    XCTAssertEqual([self.service.listRequests count], (NSUInteger)11);
+    XCTAssertTrue(self.service.largestPage <= 100, @"Page of %lu records exceeds the page size", (unsigned long)self.service.largestPage);
+
+    for (NSUInteger i = 0; i < [self.service.listRequests count]; i++) {
+        AWSCognitoSyncListRecordsRequest *request = self.service.listRequests[i];
+        XCTAssertEqualObjects(request.maxResults, @100);
+        XCTAssertEqualObjects(request.lastSyncCount, @0);
+        if (i > 0) {
+            XCTAssertNotNil(request.nextToken);
+        }
+        // every earlier page was written before the next one was requested
+        XCTAssertEqual([self.service.localRecordCounts[i] unsignedIntegerValue], MIN(i * 100, AWSCognitoDatasetTestsRecordCount));
+    }
+
+    XCTAssertEqual([[self.manager numRecords:AWSCognitoDatasetTestsDatasetName] unsignedIntegerValue], AWSCognitoDatasetTestsRecordCount);
+    XCTAssertEqual([[self.manager lastSyncCount:AWSCognitoDatasetTestsDatasetName] unsignedIntegerValue], AWSCognitoDatasetTestsRecordCount);
+    XCTAssertEqualObjects([dataset stringForKey:@"key1023"], [self.service.remoteRecords[1023] value]);
+}
+
+- (void)testSynchronizeWithoutPageSizeUsesServicePaging {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+
+    AWSTask *task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+
+    XCTAssertEqual([self.service.listRequests count], (NSUInteger)1);
+    XCTAssertNil([self.service.listRequests[0] maxResults]);
+    XCTAssertEqual([[self.manager numRecords:AWSCognitoDatasetTestsDatasetName] unsignedIntegerValue], AWSCognitoDatasetTestsRecordCount);
+}
+
+- (void)testFailedPageDoesNotAdvanceSyncCount {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:100];
+    self.service.failAtRequest = 2;
+
+    AWSTask *task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertNotNil(task.error, @"Synchronize should fail when a page cannot be listed");
+
+    // the pages already pulled are kept, but the next pull starts from the old sync count
+    XCTAssertEqual([[self.manager numRecords:AWSCognitoDatasetTestsDatasetName] unsignedIntegerValue], (NSUInteger)200);
+    XCTAssertEqual([[self.manager lastSyncCount:AWSCognitoDatasetTestsDatasetName] intValue], 0);
+}
+
+- (void)testInterruptedPullResumesFromCheckpoint {
+    for (NSInteger failAt = 1; failAt < 11; failAt++) {
+        NSString *datasetName = [NSString stringWithFormat:@"resumed%ld", (long)failAt];
+        AWSCognitoDataset *dataset = [[AWSCognitoDataset alloc] initWithDatasetName:datasetName
+                                                                      sqliteManager:self.manager
+                                                                     cognitoService:self.service];
+        dataset.synchronizeRetries = 1;
+        dataset.synchronizePageSize = 100;
+        [self.service.listRequests removeAllObjects];
+        self.service.failAtRequest = failAt;
+
+        AWSTask *task = [dataset synchronize];
+        [task waitUntilFinished];
+        XCTAssertNotNil(task.error, @"Synchronize should fail when page %ld cannot be listed", (long)failAt);
+        XCTAssertEqual([[self.manager numRecords:datasetName] integerValue], failAt * 100);
+        XCTAssertTrue([self.manager syncCheckpoint:datasetName syncCount:NULL sessionToken:NULL nextToken:NULL appliedSyncCount:NULL]);
+
+        // a new instance, as after a relaunch, picks up at the page that failed
+        dataset = [[AWSCognitoDataset alloc] initWithDatasetName:datasetName
+                                                   sqliteManager:self.manager
+                                                  cognitoService:self.service];
+        dataset.synchronizeRetries = 1;
+        dataset.synchronizePageSize = 100;
+        [self.service.listRequests removeAllObjects];
+        self.service.failAtRequest = -1;
+
+        task = [dataset synchronize];
+        [task waitUntilFinished];
+        XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+
+        XCTAssertEqual((NSInteger)[self.service.listRequests count], 11 - failAt);
+        XCTAssertEqualObjects([self.service.listRequests[0] nextToken], ([NSString stringWithFormat:@"%ld", (long)failAt * 100]));
+        XCTAssertEqualObjects([self.service.listRequests[0] syncSessionToken], @"session");
+        XCTAssertEqual([[self.manager numRecords:datasetName] unsignedIntegerValue], AWSCognitoDatasetTestsRecordCount);
+        XCTAssertEqual([[self.manager lastSyncCount:datasetName] unsignedIntegerValue], AWSCognitoDatasetTestsRecordCount);
+        XCTAssertFalse([self.manager syncCheckpoint:datasetName syncCount:NULL sessionToken:NULL nextToken:NULL appliedSyncCount:NULL]);
+    }
+}
+
+- (void)testRejectedCheckpointRestartsPull {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:100];
+    self.service.failAtRequest = 5;
+
+    AWSTask *task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertNotNil(task.error, @"Synchronize should fail when a page cannot be listed");
+
+    // the session the checkpoint was taken in has expired
+    [self.service.listRequests removeAllObjects];
+    self.service.failAtRequest = -1;
+    self.service.sessionToken = @"renewed";
+
+    task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+
+    XCTAssertEqual([self.service.listRequests count], (NSUInteger)12);
+    XCTAssertEqualObjects([self.service.listRequests[0] nextToken], @"500");
+    XCTAssertNil([self.service.listRequests[1] nextToken]);
+    XCTAssertNil([self.service.listRequests[1] syncSessionToken]);
+    XCTAssertEqual([[self.manager numRecords:AWSCognitoDatasetTestsDatasetName] unsignedIntegerValue], AWSCognitoDatasetTestsRecordCount);
+    XCTAssertEqual([[self.manager lastSyncCount:AWSCognitoDatasetTestsDatasetName] unsignedIntegerValue], AWSCognitoDatasetTestsRecordCount);
+}
+
+#pragma mark - Coalesced synchronize
+
+- (void)testPullSkipsEchoedRecords {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 1000)];
+
+    NSDate *start = [NSDate date];
+    AWSTask *task = [dataset synchronize];
+    [task waitUntilFinished];
+    NSTimeInterval firstPull = -[start timeIntervalSinceNow];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+    XCTAssertEqual(dataset.lastSynchronizeRecordsWritten, (NSUInteger)1000);
+
+    // the same records again, with one in ten changed remotely
+    NSMutableArray *remoteRecords = [NSMutableArray arrayWithCapacity:1000];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        AWSCognitoSyncRecord *record = self.service.remoteRecords[i];
+        if (i % 10 == 0) {
+            AWSCognitoSyncRecord *changed = [AWSCognitoSyncRecord new];
+            changed.key = record.key;
+            changed.value = @"changed";
+            changed.syncCount = [NSNumber numberWithLongLong:[record.syncCount longLongValue] + 1000];
+            changed.lastModifiedBy = @"remote";
+            changed.lastModifiedDate = [NSDate date];
+            record = changed;
+        }
+        [remoteRecords addObject:record];
+    }
+    self.service.remoteRecords = remoteRecords;
+
+    start = [NSDate date];
+    task = [dataset synchronize];
+    [task waitUntilFinished];
+    NSTimeInterval echoPull = -[start timeIntervalSinceNow];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+    XCTAssertEqual(dataset.lastSynchronizeRecordsWritten, (NSUInteger)100);
+    XCTAssertEqual(dataset.lastSynchronizeRecordsSkipped, (NSUInteger)900);
+    XCTAssertEqualObjects([dataset stringForKey:@"key10"], @"changed");
+    XCTAssertEqualObjects([dataset stringForKey:@"key11"], [remoteRecords[11] value]);
+
+    NSLog(@"1000 records pulled: all new %8.2fms, 90%% echoes %8.2fms", firstPull * 1000.0, echoPull * 1000.0);
+}
+
+- (void)testOverlappingSynchronizeJoinsInFlight {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 10)];
+    self.service.latency = 100;
+
+    AWSTask *first = [dataset synchronize];
+    for (int i = 0; i < 5; i++) {
+        XCTAssertEqual([dataset synchronize], first, @"Callers during a sync should get the sync in flight");
+    }
+    [first waitUntilFinished];
+    XCTAssertNil(first.error, @"Synchronize failed [%@]", first.error);
+    XCTAssertEqual([self.service.listRequests count], (NSUInteger)1);
+
+    // once finished, the next call starts a new sync
+    AWSTask *next = [dataset synchronize];
+    XCTAssertNotEqual(next, first);
+    [next waitUntilFinished];
+    XCTAssertEqual([self.service.listRequests count], (NSUInteger)2);
+}
+
+- (void)testWritesDuringSynchronizeQueueOneFollowUp {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 10)];
+    self.service.latency = 100;
+
+    AWSTask *first = [dataset synchronize];
+    [dataset setString:@"value" forKey:@"local"];
+    AWSTask *followUp = [dataset synchronize];
+    XCTAssertNotEqual(followUp, first, @"A write during the sync should queue a follow-up");
+    [dataset setString:@"value" forKey:@"another"];
+    XCTAssertEqual([dataset synchronize], followUp, @"Callers before the follow-up starts should share it");
+
+    [followUp waitUntilFinished];
+    XCTAssertTrue(first.completed, @"The follow-up should only start once the first sync finished");
+    XCTAssertNil(followUp.error, @"Synchronize failed [%@]", followUp.error);
+    XCTAssertEqual([self.service.listRequests count], (NSUInteger)2);
+}
+
+- (void)testDebouncedSynchronizeCoalescesBurst {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    self.service.remoteRecords = @[];
+    dataset.synchronizeDebounceInterval = 0.2;
+
+    NSMutableSet *tasks = [NSMutableSet new];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [dataset setString:@"value" forKey:[NSString stringWithFormat:@"key%lu", (unsigned long)i]];
+        [tasks addObject:[dataset synchronize]];
+    }
+    XCTAssertEqual([tasks count], (NSUInteger)1, @"Every call in the debounce window should share one sync");
+
+    AWSTask *task = [tasks anyObject];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+    XCTAssertEqual([self.service.listRequests count], (NSUInteger)1);
+    XCTAssertEqual([self.service.updateRequests count], (NSUInteger)1);
+    XCTAssertEqual([[self.service.updateRequests[0] recordPatches] count], (NSUInteger)10, @"The one push should carry the whole burst");
+}
+
+#pragma mark - Chunked push
+
+// Pushes recordCount local changes to a fresh dataset, rejecting the given UpdateRecords call with a
+// conflict, and returns the patch bytes sent.
+- (NSUInteger)patchBytesSentPushing:(NSUInteger)recordCount
+                          batchSize:(uint32_t)batchSize
+                   conflictAtUpdate:(NSInteger)conflictAtUpdate
+                        datasetName:(NSString *)datasetName {
+    AWSCognitoDataset *dataset = [[AWSCognitoDataset alloc] initWithDatasetName:datasetName
+                                                                  sqliteManager:self.manager
+                                                                 cognitoService:self.service];
+    dataset.synchronizeRetries = 3;
+    dataset.synchronizePushBatchSize = batchSize;
+
+    NSString *value = [@"" stringByPaddingToLength:1000 withString:@"v" startingAtIndex:0];
+    for (NSUInteger i = 0; i < recordCount; i++) {
+        [dataset setString:value forKey:[NSString stringWithFormat:@"key%03lu", (unsigned long)i]];
+    }
+
+    NSUInteger bytesBefore = self.service.patchBytesSent;
+    self.service.conflictAtUpdate = (NSInteger)[self.service.updateRequests count] + conflictAtUpdate;
+    AWSTask *task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+
+    NSError *error = nil;
+    XCTAssertEqual([[self.manager recordsUpdatedAfterLastSync:datasetName error:&error] count], (NSUInteger)0, @"Every change should have been accepted");
+    return self.service.patchBytesSent - bytesBefore;
+}
+
+- (void)testChunkedPushResendsOnlyRemainingBatches {
+    self.service.remoteRecords = @[];
+
+    NSUInteger unchunkedBytes = [self patchBytesSentPushing:300 batchSize:0 conflictAtUpdate:0 datasetName:@"unchunked"];
+    XCTAssertEqual([self.service.updateRequests count], (NSUInteger)2);
+
+    NSUInteger firstChunkedRequest = [self.service.updateRequests count];
+    NSUInteger chunkedBytes = [self patchBytesSentPushing:300 batchSize:100 conflictAtUpdate:1 datasetName:@"chunked"];
+    NSArray *chunkedRequests = [self.service.updateRequests subarrayWithRange:NSMakeRange(firstChunkedRequest, [self.service.updateRequests count] - firstChunkedRequest)];
+    XCTAssertEqual([chunkedRequests count], (NSUInteger)4, @"The accepted batch should not be sent again after the conflict");
+    for (AWSCognitoSyncUpdateRecordsRequest *request in chunkedRequests) {
+        XCTAssertEqual([request.recordPatches count], (NSUInteger)100);
+    }
+    XCTAssertEqualObjects([[chunkedRequests[2] recordPatches][0] key], @"key100", @"The rejected batch should be retried first");
+
+    NSLog(@"300 changes, conflict on the second request: unchunked sent %lu bytes, chunked by 100 sent %lu bytes",
+          (unsigned long)unchunkedBytes, (unsigned long)chunkedBytes);
+    XCTAssertEqual(unchunkedBytes, chunkedBytes * 3 / 2, @"Unchunked resends all 300 changes, chunked only the 100 rejected");
+}
+
+#pragma mark - Conflict retries
+
+- (void)testConflictRetryBudgetIsShared {
+    self.service.remoteRecords = @[];
+    [AWSCognito setSynchronizeRetryBudget:1];
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    dataset.synchronizeRetries = 3;
+
+    [dataset setString:@"value" forKey:@"key"];
+    self.service.conflictAtUpdate = 0;
+    AWSTask *task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error, @"Synchronize failed [%@]", task.error);
+    XCTAssertEqual(dataset.lastSynchronizeAttempts, (uint32_t)2);
+    XCTAssertEqual([AWSCognito synchronizeRetriesAvailable], (uint32_t)1, @"The successful synchronize should return its retry");
+
+    [AWSCognito setSynchronizeRetryBudget:0];
+    [dataset setString:@"value2" forKey:@"key"];
+    self.service.conflictAtUpdate = (NSInteger)[self.service.updateRequests count];
+    task = [dataset synchronize];
+    [task waitUntilFinished];
+    XCTAssertEqual(task.error.code, AWSCognitoErrorConflictRetriesExhausted);
+    XCTAssertEqual(dataset.lastSynchronizeAttempts, (uint32_t)1, @"Nothing should be retried once the budget is spent");
+}
+
+// Every device writes its own key and synchronizes at the same moment against one remote dataset.
+- (void)simulateDevices:(NSUInteger)deviceCount retryBaseDelay:(NSTimeInterval)retryBaseDelay run:(NSString *)run {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    AWSCognitoDatasetTestsContendedService *service = [[AWSCognitoDatasetTestsContendedService alloc] initWithConfiguration:self.configuration];
+#pragma clang diagnostic pop
+    service.records = [NSMutableDictionary new];
+    service.latency = 20;
+
+    NSMutableArray *datasets = [NSMutableArray arrayWithCapacity:deviceCount];
+    NSMutableArray *tasks = [NSMutableArray arrayWithCapacity:deviceCount];
+    for (NSUInteger i = 0; i < deviceCount; i++) {
+        NSString *deviceName = [NSString stringWithFormat:@"%@device%lu", run, (unsigned long)i];
+        AWSCognitoDataset *dataset = [[AWSCognitoDataset alloc] initWithDatasetName:deviceName
+                                                                      sqliteManager:self.manager
+                                                                     cognitoService:service];
+        dataset.synchronizeRetries = 5;
+        dataset.synchronizeRetryBaseDelay = retryBaseDelay;
+        dataset.synchronizeRetryMaxDelay = 1;
+        [dataset setString:@"value" forKey:deviceName];
+        [datasets addObject:dataset];
+    }
+    NSDate *start = [NSDate date];
+    for (AWSCognitoDataset *dataset in datasets) {
+        [tasks addObject:[dataset synchronize]];
+    }
+    [[AWSTask taskForCompletionOfAllTasks:tasks] waitUntilFinished];
+    NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+    NSUInteger succeeded = 0;
+    NSUInteger successfulAttempts = 0;
+    for (NSUInteger i = 0; i < deviceCount; i++) {
+        AWSTask *task = tasks[i];
+        AWSCognitoDataset *dataset = datasets[i];
+        XCTAssertGreaterThanOrEqual(dataset.lastSynchronizeAttempts, (uint32_t)1);
+        XCTAssertLessThanOrEqual(dataset.lastSynchronizeAttempts, (uint32_t)5);
+        if (task.error) {
+            XCTAssertEqual(task.error.code, AWSCognitoErrorConflictRetriesExhausted, @"Only conflicts should fail [%@]", task.error);
+        } else {
+            succeeded++;
+            successfulAttempts += dataset.lastSynchronizeAttempts;
+        }
+    }
+    XCTAssertEqual((NSUInteger)service.syncCount, succeeded, @"Every accepted update should belong to a successful synchronize");
+
+    NSLog(@"%lu devices, retry base delay %.2fs: %lu succeeded, %lu conflicts, %.2f attempts per successful synchronize, %.2fs",
+          (unsigned long)deviceCount, retryBaseDelay, (unsigned long)succeeded, (unsigned long)service.conflicts,
+          succeeded ? (double)successfulAttempts / succeeded : 0.0, elapsed);
+}
+
+- (void)testContendedSynchronizeSimulation {
+    [AWSCognito setSynchronizeRetryBudget:1000];
+    [self simulateDevices:8 retryBaseDelay:0 run:@"immediate"];
+    [self simulateDevices:8 retryBaseDelay:0.05 run:@"backoff"];
+}
+
+#pragma mark - Skipping unchanged datasets
+
+- (void)setRemoteLastModified:(NSTimeInterval)lastModified {
+    AWSCognitoSyncDataset *remoteDataset = [AWSCognitoSyncDataset new];
+    remoteDataset.datasetName = AWSCognitoDatasetTestsDatasetName;
+    remoteDataset.lastModifiedDate = [NSDate dateWithTimeIntervalSince1970:lastModified];
+    remoteDataset.lastModifiedBy = @"remote";
+    remoteDataset.dataStorage = @0;
+    remoteDataset.numRecords = [NSNumber numberWithUnsignedInteger:[self.service.remoteRecords count]];
+    self.service.remoteDatasets = @[remoteDataset];
+}
+
+- (NSArray *)callsDuring:(void (^)(void))block {
+    NSUInteger start = [self.service.calls count];
+    block();
+    return [self.service.calls subarrayWithRange:NSMakeRange(start, [self.service.calls count] - start)];
+}
+
+- (void)testSynchronizeSkipsUnchangedPull {
+    AWSCognito *cognito = [self cognitoClient];
+    cognito.synchronizeSkipsUnchangedPull = YES;
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 10)];
+    [self setRemoteLastModified:1000];
+    AWSCognitoDataset *dataset = [cognito openOrCreateDataset:AWSCognitoDatasetTestsDatasetName];
+
+    // never pulled
+    NSArray *calls = [self callsDuring:^{
+        [[cognito refreshDatasetMetadata] waitUntilFinished];
+        [[dataset synchronize] waitUntilFinished];
+    }];
+    XCTAssertEqualObjects(calls, (@[@"ListDatasets", @"ListRecords"]));
+
+    // unchanged since the pull
+    calls = [self callsDuring:^{
+        [[dataset synchronize] waitUntilFinished];
+    }];
+    XCTAssertEqualObjects(calls, @[]);
+
+    // changed remotely
+    [self setRemoteLastModified:2000];
+    calls = [self callsDuring:^{
+        [[cognito refreshDatasetMetadata] waitUntilFinished];
+        [[dataset synchronize] waitUntilFinished];
+        [[dataset synchronize] waitUntilFinished];
+    }];
+    XCTAssertEqualObjects(calls, (@[@"ListDatasets", @"ListRecords"]));
+
+    // turned off
+    dataset.synchronizeSkipsUnchangedPull = NO;
+    calls = [self callsDuring:^{
+        [[dataset synchronize] waitUntilFinished];
+    }];
+    XCTAssertEqualObjects(calls, @[@"ListRecords"]);
+    dataset.synchronizeSkipsUnchangedPull = YES;
+
+    // no longer listed, so it may have been deleted
+    self.service.remoteDatasets = @[];
+    calls = [self callsDuring:^{
+        [[cognito refreshDatasetMetadata] waitUntilFinished];
+        [[dataset synchronize] waitUntilFinished];
+    }];
+    XCTAssertEqualObjects(calls, (@[@"ListDatasets", @"ListRecords"]));
+
+    // changed locally, the push still needs the session token from a pull
+    [self setRemoteLastModified:2000];
+    calls = [self callsDuring:^{
+        [[cognito refreshDatasetMetadata] waitUntilFinished];
+        [[dataset synchronize] waitUntilFinished];
+        [dataset setString:@"value" forKey:@"local"];
+        [[dataset synchronize] waitUntilFinished];
+    }];
+    XCTAssertEqualObjects(calls, (@[@"ListDatasets", @"ListRecords", @"UpdateRecords"]));
+}
+
+#pragma mark - Scheduled synchronize
+
+- (AWSCognito *)schedulingClient:(AWSCognitoDatasetTestsClock *)clock {
+    AWSCognito *cognito = [self cognitoClient];
+    cognito.schedulerDispatchAfter = ^(NSTimeInterval delay, dispatch_block_t block) {
+        [clock schedule:block after:delay];
+    };
+    [self stubReachability:cognito];
+    return cognito;
+}
+
+- (AWSCognitoDatasetTestsReachability *)stubReachability:(AWSCognito *)cognito {
+    AWSCognitoDatasetTestsReachability *reachability = (AWSCognitoDatasetTestsReachability *)[AWSCognitoDatasetTestsReachability reachabilityWithHostname:@"localhost"];
+    cognito.reachability = reachability;
+    return reachability;
+}
+
+- (NSUInteger)callCount:(NSString *)operation {
+    @synchronized(self.service) {
+        return [[[NSCountedSet alloc] initWithArray:self.service.calls] countForObject:operation];
+    }
+}
+
+- (void)testSchedulerBatchesWritesUntilFlushInterval {
+    self.service.remoteRecords = @[];
+    AWSCognitoDatasetTestsClock *clock = [AWSCognitoDatasetTestsClock new];
+    AWSCognito *cognito = [self schedulingClient:clock];
+    [cognito enableSynchronizeScheduler:30 flushThreshold:0 maxConcurrency:4];
+    AWSCognitoDataset *first = [cognito openOrCreateDataset:@"first"];
+    AWSCognitoDataset *second = [cognito openOrCreateDataset:@"second"];
+
+    for (NSUInteger i = 0; i < 10; i++) {
+        [first setString:@"value" forKey:[NSString stringWithFormat:@"key%lu", (unsigned long)i]];
+        [second setString:@"value" forKey:[NSString stringWithFormat:@"key%lu", (unsigned long)i]];
+        [clock advance:1];
+    }
+    XCTAssertEqual([self.service.calls count], (NSUInteger)0, @"Nothing should be sent before the flush interval");
+
+    [clock advance:20];
+    [cognito.scheduledFlushTask waitUntilFinished];
+    XCTAssertEqual([cognito.scheduledFlushTask.result count], (NSUInteger)2);
+    XCTAssertEqual([self callCount:@"ListRecords"], (NSUInteger)2);
+    XCTAssertEqual([self callCount:@"UpdateRecords"], (NSUInteger)2, @"Twenty writes should go out in one push per dataset");
+
+    // the next write starts a new interval
+    [first setString:@"value" forKey:@"late"];
+    [clock advance:29];
+    XCTAssertEqual([self callCount:@"UpdateRecords"], (NSUInteger)2);
+    [clock advance:1];
+    [cognito.scheduledFlushTask waitUntilFinished];
+    XCTAssertEqual([self callCount:@"UpdateRecords"], (NSUInteger)3);
+
+    [cognito disableSynchronizeScheduler];
+    [first setString:@"value" forKey:@"unscheduled"];
+    [clock advance:60];
+    XCTAssertEqual([self callCount:@"UpdateRecords"], (NSUInteger)3, @"Writes shouldn't be queued once the scheduler is off");
+}
+
+- (void)testSchedulerFlushesAtThreshold {
+    self.service.remoteRecords = @[];
+    AWSCognitoDatasetTestsClock *clock = [AWSCognitoDatasetTestsClock new];
+    AWSCognito *cognito = [self schedulingClient:clock];
+    [cognito enableSynchronizeScheduler:0 flushThreshold:3 maxConcurrency:4];
+
+    NSArray *datasetNames = [self datasetNames:3];
+    for (NSString *datasetName in datasetNames) {
+        AWSCognitoDataset *dataset = [cognito openOrCreateDataset:datasetName];
+        [dataset setString:@"value" forKey:@"first"];
+        [dataset setString:@"value" forKey:@"second"];
+    }
+    XCTAssertEqual([clock.timers count], (NSUInteger)0, @"Without an interval only the threshold should flush");
+
+    [cognito.scheduledFlushTask waitUntilFinished];
+    XCTAssertEqualObjects([NSSet setWithArray:[cognito.scheduledFlushTask.result allKeys]], [NSSet setWithArray:datasetNames]);
+    XCTAssertEqual([self callCount:@"ListRecords"], (NSUInteger)3);
+}
+
+- (void)testSchedulerCapsConcurrentSynchronizes {
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 10)];
+    self.service.latency = 50;
+    AWSCognitoDatasetTestsClock *clock = [AWSCognitoDatasetTestsClock new];
+    AWSCognito *cognito = [self schedulingClient:clock];
+    [cognito enableSynchronizeScheduler:1 flushThreshold:0 maxConcurrency:2];
+
+    NSArray *datasetNames = [self datasetNames:9];
+    for (NSUInteger i = 0; i < 6; i++) {
+        [[cognito openOrCreateDataset:datasetNames[i]] setString:@"value" forKey:@"key"];
+    }
+    [clock advance:1];
+    // a second flush while the first is still running
+    for (NSUInteger i = 6; i < 9; i++) {
+        [[cognito openOrCreateDataset:datasetNames[i]] setString:@"value" forKey:@"key"];
+    }
+    AWSTask *task = [cognito flushScheduledSynchronizes];
+    [task waitUntilFinished];
+
+    XCTAssertEqual([task.result count], (NSUInteger)3);
+    XCTAssertEqual([self callCount:@"ListRecords"], (NSUInteger)9);
+    XCTAssertLessThanOrEqual(self.service.peakActiveRequests, (NSUInteger)2);
+}
+
+- (void)testSchedulerWaitsForConnectivity {
+    self.service.remoteRecords = @[];
+    AWSCognitoDatasetTestsClock *clock = [AWSCognitoDatasetTestsClock new];
+    AWSCognito *cognito = [self schedulingClient:clock];
+    AWSCognitoDatasetTestsReachability *reachability = (AWSCognitoDatasetTestsReachability *)cognito.reachability;
+    reachability.offline = YES;
+    [cognito enableSynchronizeScheduler:0 flushThreshold:1 maxConcurrency:4];
+
+    AWSCognitoDataset *dataset = [cognito openOrCreateDataset:AWSCognitoDatasetTestsDatasetName];
+    [dataset setString:@"value" forKey:@"key"];
+    [dataset setString:@"value" forKey:@"key2"];
+    XCTAssertEqual([self.service.calls count], (NSUInteger)0);
+    XCTAssertNotNil(reachability.reachableBlock, @"The flush should wait for the network");
+
+    reachability.offline = NO;
+    reachability.reachableBlock(reachability);
+    [cognito.scheduledFlushTask waitUntilFinished];
+    XCTAssertEqual([self callCount:@"UpdateRecords"], (NSUInteger)1);
+    XCTAssertEqual([[self.service.updateRequests[0] recordPatches] count], (NSUInteger)2);
+}
+
+- (void)testOneReachabilityEventResumesEveryWaitingSynchronize {
+    self.service.remoteRecords = @[];
+    AWSCognito *cognito = [self cognitoClient];
+    AWSCognitoDatasetTestsReachability *reachability = [self stubReachability:cognito];
+    reachability.offline = YES;
+
+    NSMutableArray *datasets = [NSMutableArray new];
+    for (NSString *datasetName in [self datasetNames:5]) {
+        AWSCognitoDataset *dataset = [cognito openOrCreateDataset:datasetName];
+        [dataset setString:@"value" forKey:@"key"];
+        [[dataset synchronizeOnConnectivity] waitUntilFinished];
+        [[dataset synchronizeOnConnectivity] waitUntilFinished];
+        [datasets addObject:dataset];
+    }
+    XCTAssertEqual([self.service.calls count], (NSUInteger)0);
+    XCTAssertTrue(reachability.notifierRunning);
+
+    reachability.offline = NO;
+    reachability.reachableBlock(reachability);
+    XCTAssertFalse(reachability.notifierRunning, @"The notifier should stop once nothing is waiting");
+    for (AWSCognitoDataset *dataset in datasets) {
+        // waits for the synchronize the reachability event started
+        [[dataset synchronize] waitUntilFinished];
+    }
+    XCTAssertEqual([self callCount:@"UpdateRecords"], (NSUInteger)5, @"Each dataset should push once");
+}
+
+#pragma mark - Open datasets
+
+- (void)testOpenDatasetReusesOpenInstance {
+    AWSCognito *cognito = [self cognitoClient];
+    AWSCognitoDataset *dataset = [cognito openOrCreateDataset:@"reused"];
+    XCTAssertEqual([cognito openOrCreateDataset:@"reused"], dataset);
+    XCTAssertNotEqual([cognito openOrCreateDataset:@"other"], dataset);
+
+    __weak AWSCognitoDataset *released = nil;
+    @autoreleasepool {
+        AWSCognitoDataset *releasedDataset = [cognito openOrCreateDataset:@"released"];
+        [releasedDataset setString:@"value" forKey:@"key"];
+        released = releasedDataset;
+    }
+    XCTAssertNil(released, @"Open datasets shouldn't be kept alive by the client");
+    XCTAssertEqualObjects([[cognito openOrCreateDataset:@"released"] stringForKey:@"key"], @"value");
+}
+
+- (void)testOpenDatasetTimings {
+    AWSCognito *cognito = [self cognitoClient];
+    NSArray *datasetNames = [self datasetNames:500];
+
+    NSDate *start = [NSDate date];
+    @autoreleasepool {
+        for (NSString *datasetName in datasetNames) {
+            [cognito openOrCreateDataset:datasetName];
+        }
+    }
+    NSTimeInterval firstOpens = -[start timeIntervalSinceNow];
+
+    AWSCognitoDataset *dataset = [cognito openOrCreateDataset:AWSCognitoDatasetTestsDatasetName];
+    start = [NSDate date];
+    AWSCognitoDataset *reopened = nil;
+    for (NSUInteger i = 0; i < [datasetNames count]; i++) {
+        reopened = [cognito openOrCreateDataset:AWSCognitoDatasetTestsDatasetName];
+    }
+    NSTimeInterval repeatedOpens = -[start timeIntervalSinceNow];
+    XCTAssertEqual(reopened, dataset);
+
+    NSLog(@"%lu opens: new datasets %8.2fms, already open %8.2fms",
+          (unsigned long)[datasetNames count], firstOpens * 1000.0, repeatedOpens * 1000.0);
+    XCTAssertLessThan(repeatedOpens, firstOpens / 10, @"Opening an open dataset shouldn't touch the database");
+}
+
+#pragma mark - Multi-dataset synchronize
+
+- (AWSCognito *)cognitoClient {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    AWSCognito *cognito = [[AWSCognito alloc] initWithConfiguration:self.configuration];
+#pragma clang diagnostic pop
+    cognito.sqliteManager = self.manager;
+    cognito.cognitoService = self.service;
+    return cognito;
+}
+
+- (NSArray *)datasetNames:(NSUInteger)count {
+    NSMutableArray *datasetNames = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [datasetNames addObject:[NSString stringWithFormat:@"dataset%lu", (unsigned long)i]];
+    }
+    return datasetNames;
+}
+
+- (void)testSynchronizeDatasets {
+    AWSCognito *cognito = [self cognitoClient];
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 10)];
+    NSArray *datasetNames = [self datasetNames:20];
+    AWSCognitoDatasetTestsIdentityRequests = 0;
+
+    AWSTask *task = [cognito synchronizeDatasets:[datasetNames arrayByAddingObject:@"dataset0"] maxConcurrency:4];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error);
+
+    NSDictionary *results = task.result;
+    XCTAssertEqual([results count], [datasetNames count]);
+    XCTAssertEqual([self.service.listRequests count], [datasetNames count], @"Each dataset should be synchronized once");
+    XCTAssertEqual(AWSCognitoDatasetTestsIdentityRequests, (NSUInteger)1, @"The identity should be resolved once for all datasets");
+    for (NSString *datasetName in datasetNames) {
+        AWSTask *datasetTask = [results objectForKey:datasetName];
+        XCTAssertNotNil(datasetTask);
+        XCTAssertNil(datasetTask.error, @"Synchronize of %@ failed [%@]", datasetName, datasetTask.error);
+        XCTAssertEqual([[self.manager numRecords:datasetName] intValue], 10);
+    }
+}
+
+- (void)testSynchronizeDatasetsReportsFailures {
+    AWSCognito *cognito = [self cognitoClient];
+    cognito.synchronizeRetries = 1;
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 10)];
+    self.service.failAtRequest = 0;
+
+    // one at a time, so the first dataset gets the failing request
+    AWSTask *task = [cognito synchronizeDatasets:@[@"failing", @"succeeding"] maxConcurrency:1];
+    [task waitUntilFinished];
+    XCTAssertNil(task.error);
+    XCTAssertNotNil([[task.result objectForKey:@"failing"] error]);
+    XCTAssertNil([[task.result objectForKey:@"succeeding"] error]);
+    XCTAssertEqual([[self.manager numRecords:@"succeeding"] intValue], 10);
+}
+
+- (void)testSynchronizeDatasetsTimings {
+    self.service.remoteRecords = [self.service.remoteRecords subarrayWithRange:NSMakeRange(0, 10)];
+    self.service.latency = 50;
+    NSArray *datasetNames = [self datasetNames:20];
+    NSMutableDictionary *timings = [NSMutableDictionary new];
+
+    for (NSNumber *maxConcurrency in @[@1, @4, @8]) {
+        AWSCognito *cognito = [self cognitoClient];
+        [self.manager deleteAllData];
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        AWSTask *task = [cognito synchronizeDatasets:datasetNames maxConcurrency:[maxConcurrency unsignedIntegerValue]];
+        [task waitUntilFinished];
+        CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+        XCTAssertEqual([task.result count], [datasetNames count]);
+        [timings setObject:@(elapsed) forKey:maxConcurrency];
+        NSLog(@"%lu datasets, %dms latency, concurrency %@: %8.2fms", (unsigned long)[datasetNames count], self.service.latency, maxConcurrency, elapsed * 1000.0);
+    }
+
+    XCTAssertLessThan([timings[@4] doubleValue], [timings[@1] doubleValue] / 2, @"Concurrent synchronize should overlap request latency");
+}
+
+#pragma mark - Batch writes
+
+- (void)testSetStrings {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    [dataset setString:@"old" forKey:@"existing"];
+
+    [dataset setStrings:@{@"existing": @"new", @"added": @"value"}];
+
+    XCTAssertEqualObjects([dataset stringForKey:@"existing"], @"new");
+    XCTAssertEqualObjects([dataset stringForKey:@"added"], @"value");
+    XCTAssertEqual([[self.manager numRecords:AWSCognitoDatasetTestsDatasetName] intValue], 2);
+}
+
+- (void)testPutRecordsIsAllOrNothing {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    NSString *longKey = [@"" stringByPaddingToLength:129 withString:@"k" startingAtIndex:0];
+    AWSCognitoRecordValue *value = [[AWSCognitoRecordValue alloc] initWithString:@"value"];
+    NSArray *records = @[[[AWSCognitoRecord alloc] initWithId:@"valid" data:value],
+                         [[AWSCognitoRecord alloc] initWithId:longKey data:value]];
+
+    NSError *error = nil;
+    XCTAssertFalse([dataset putRecords:records error:&error]);
+    XCTAssertEqual(error.code, AWSCognitoErrorIllegalArgument);
+    XCTAssertNil([dataset stringForKey:@"valid"], @"No record should be written when one is invalid");
+}
+
+- (void)testSizeFollowsWrites {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    XCTAssertEqual([dataset size], 0L);
+
+    [dataset setStrings:@{@"wifi": @"on", @"rememberme": @"off"}];
+    XCTAssertEqual([dataset size], 6L + 13L);
+    [dataset setString:@"off" forKey:@"wifi"];
+    XCTAssertEqual([dataset size], 7L + 13L);
+    [dataset removeObjectForKey:@"rememberme"];
+    XCTAssertEqual([dataset size], 7L + 10L);
+    XCTAssertEqual([dataset size], [dataset sizeForKey:@"wifi"] + [dataset sizeForKey:@"rememberme"]);
+}
+
+- (void)testSetStringReplacesAtRecordLimit {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    NSMutableDictionary *strings = [NSMutableDictionary dictionaryWithCapacity:AWSCognitoMaxNumRecords];
+    for (uint32_t i = 0; i < AWSCognitoMaxNumRecords; i++) {
+        [strings setObject:@"value" forKey:[NSString stringWithFormat:@"key%u", i]];
+    }
+    [dataset setStrings:strings];
+
+    [dataset setString:@"updated" forKey:@"key0"];
+    XCTAssertEqualObjects([dataset stringForKey:@"key0"], @"updated", @"Existing keys can still be written at the limit");
+    [dataset setString:@"value" forKey:@"overflow"];
+    XCTAssertNil([dataset stringForKey:@"overflow"], @"New keys are rejected at the limit");
+}
+
+- (void)testBatchWriteTimings {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    NSArray *batchSizes = @[@1, @10, @100, @1000];
+
+    for (NSNumber *batchSize in batchSizes) {
+        NSMutableDictionary *strings = [NSMutableDictionary dictionaryWithCapacity:[batchSize unsignedIntegerValue]];
+        for (NSUInteger i = 0; i < [batchSize unsignedIntegerValue]; i++) {
+            [strings setObject:@"value" forKey:[NSString stringWithFormat:@"key%lu", (unsigned long)i]];
+        }
+
+        [dataset clear];
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSString *key in strings) {
+            [dataset setString:[strings objectForKey:key] forKey:key];
+        }
+        CFAbsoluteTime perKey = CFAbsoluteTimeGetCurrent() - start;
+
+        [dataset clear];
+        start = CFAbsoluteTimeGetCurrent();
+        [dataset setStrings:strings];
+        CFAbsoluteTime batched = CFAbsoluteTimeGetCurrent() - start;
+
+        XCTAssertEqual([[dataset getAll] count], [strings count]);
+        NSLog(@"%4lu keys: setString:forKey: %8.2fms, setStrings: %8.2fms", (unsigned long)[strings count], perKey * 1000.0, batched * 1000.0);
+    }
+}
+
+- (void)testSetStringsPerformance {
+    AWSCognitoDataset *dataset = [self openDatasetWithPageSize:0];
+    NSMutableDictionary *strings = [NSMutableDictionary dictionaryWithCapacity:1000];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [strings setObject:@"value" forKey:[NSString stringWithFormat:@"key%lu", (unsigned long)i]];
+    }
+
+    [self measureBlock:^{
+        [dataset setStrings:strings];
+    }];
+}
+
+@end
+
+#endif
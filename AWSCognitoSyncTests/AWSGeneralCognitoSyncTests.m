@@ -18,9 +18,56 @@
 #import <OCMock/OCMock.h>
 #import "AWSTestUtility.h"
 #import "AWSCognitoSync.h"
+#import "AWSCognitoSyncResources.h"
+#import <zlib.h>
 
 static id mockNetworking = nil;
 
+/**
+ Stands in for the service: runs the serializers of each request the way AWSNetworking does,
+ answering the first attempts with throttling errors.
+ */
+@interface AWSGeneralCognitoSyncTestsEndpoint : AWSNetworking
+
+@property (nonatomic, strong) NSData *responseData;
+@property (nonatomic, assign) NSUInteger throttledAttempts;
+@property (nonatomic, assign) int latency;
+
+@end
+
+@implementation AWSGeneralCognitoSyncTestsEndpoint
+
+- (AWSTask *)sendRequest:(AWSNetworkingRequest *)request {
+    return [self attempt:request remainingThrottles:self.throttledAttempts];
+}
+
+- (AWSTask *)attempt:(AWSNetworkingRequest *)request remainingThrottles:(NSUInteger)remainingThrottles {
+    NSMutableURLRequest *URLRequest = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://cognito-sync.us-east-1.amazonaws.com"]];
+    URLRequest.HTTPMethod = @"POST";
+    return [[[request.requestSerializer serializeRequest:URLRequest headers:request.headers parameters:request.parameters] continueWithSuccessBlock:^id(AWSTask *task) {
+        return [AWSTask taskWithDelay:self.latency];
+    }] continueWithSuccessBlock:^id(AWSTask *task) {
+        NSHTTPURLResponse *response = nil;
+        NSData *data = nil;
+        if (remainingThrottles > 0) {
+            response = [[NSHTTPURLResponse alloc] initWithURL:URLRequest.URL statusCode:400 HTTPVersion:@"HTTP/1.1" headerFields:@{@"x-amzn-ErrorType" : @"TooManyRequestsException:"}];
+            data = [@"{\"message\":\"Rate exceeded\"}" dataUsingEncoding:NSUTF8StringEncoding];
+        } else {
+            response = [[NSHTTPURLResponse alloc] initWithURL:URLRequest.URL statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:@{}];
+            data = self.responseData;
+        }
+
+        NSError *error = nil;
+        id result = [request.responseSerializer responseObjectForResponse:response originalRequest:URLRequest currentRequest:URLRequest data:data error:&error];
+        if (error && remainingThrottles > 0) {
+            return [self attempt:request remainingThrottles:remainingThrottles - 1];
+        }
+        return error ? [AWSTask taskWithError:error] : [AWSTask taskWithResult:result];
+    }];
+}
+
+@end
+
 @interface AWSGeneralCognitoSyncTests : XCTestCase
 
 @end
@@ -448,4 +495,259 @@ static id mockNetworking = nil;
     [AWSCognitoSync removeCognitoSyncForKey:key];
 }
 
+
+- (void)testSerializersAreReusedPerOperation {
+    NSString *key = @"testSerializersAreReusedPerOperation";
+    AWSServiceConfiguration *configuration = [[AWSServiceConfiguration alloc] initWithRegion:AWSRegionUSEast1 credentialsProvider:nil];
+    [AWSCognitoSync registerCognitoSyncWithConfiguration:configuration forKey:key];
+
+    NSMutableArray *sentRequests = [NSMutableArray new];
+    id recordingNetworking = OCMClassMock([AWSNetworking class]);
+    AWSTask *errorTask = [AWSTask taskWithError:[NSError errorWithDomain:@"OCMockExpectedNetworkingError" code:8848 userInfo:nil]];
+    OCMStub([recordingNetworking sendRequest:[OCMArg checkWithBlock:^BOOL(id request) {
+        [sentRequests addObject:request];
+        return YES;
+    }]]).andReturn(errorTask);
+
+    AWSCognitoSync *awsClient = [AWSCognitoSync CognitoSyncForKey:key];
+    [awsClient setValue:recordingNetworking forKey:@"networking"];
+
+    NSDate *start = [NSDate date];
+    for (int i = 0; i < 1000; i++) {
+        [[awsClient listRecords:[AWSCognitoSyncListRecordsRequest new]] waitUntilFinished];
+    }
+    NSTimeInterval listRecordsTime = -[start timeIntervalSinceNow];
+    [[awsClient updateRecords:[AWSCognitoSyncUpdateRecordsRequest new]] waitUntilFinished];
+
+    XCTAssertEqual([sentRequests count], (NSUInteger)1001);
+    AWSNetworkingRequest *first = sentRequests[0];
+    AWSNetworkingRequest *last = sentRequests[999];
+    XCTAssertNotNil(first.requestSerializer);
+    XCTAssertEqual(first.requestSerializer, last.requestSerializer);
+    XCTAssertEqual(first.responseSerializer, last.responseSerializer);
+
+    // each operation keeps serializers of its own
+    AWSNetworkingRequest *update = sentRequests[1000];
+    XCTAssertNotEqual(first.requestSerializer, update.requestSerializer);
+    XCTAssertNotEqual(first.responseSerializer, update.responseSerializer);
+
+    NSLog(@"1000 listRecords requests built in %8.2fms", listRecordsTime * 1000.0);
+
+    [AWSCognitoSync removeCognitoSyncForKey:key];
+}
+
+
+/**
+ * A response body of about 1 MB, the size of a full ListRecords page.
+ */
+- (NSData *)recordPageOfSize:(NSUInteger)recordCount {
+    NSString *value = [@"" stringByPaddingToLength:1000 withString:@"v" startingAtIndex:0];
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:recordCount];
+    for (NSUInteger i = 0; i < recordCount; i++) {
+        [records addObject:@{@"Key" : [NSString stringWithFormat:@"key%lu", (unsigned long)i],
+                             @"Value" : value,
+                             @"SyncCount" : @(i + 1),
+                             @"LastModifiedBy" : @"device",
+                             @"LastModifiedDate" : @(1460000000.5 + i),
+                             @"DeviceLastModifiedDate" : @(1460000000.25 + i)}];
+    }
+    NSDictionary *page = @{@"Count" : @(recordCount),
+                           @"DatasetDeletedAfterRequestedSyncCount" : @NO,
+                           @"DatasetExists" : @YES,
+                           @"DatasetSyncCount" : @(recordCount),
+                           @"LastModifiedBy" : @"device",
+                           @"MergedDatasetNames" : @[@"merged"],
+                           @"NextToken" : @"next",
+                           @"Records" : records,
+                           @"SyncSessionToken" : @"session"};
+    return [NSJSONSerialization dataWithJSONObject:page options:0 error:nil];
+}
+
+- (void)testRecordPagesDecodeLikeTheModelAdapter {
+    NSData *data = [self recordPageOfSize:1000];
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:@"https://cognito-sync.us-east-1.amazonaws.com/"]
+                                                              statusCode:200
+                                                             HTTPVersion:@"HTTP/1.1"
+                                                            headerFields:@{}];
+
+    for (NSString *operationName in @[@"ListRecords", @"UpdateRecords"]) {
+        Class outputClass = [operationName isEqualToString:@"ListRecords"] ? [AWSCognitoSyncListRecordsResponse class] : [AWSCognitoSyncUpdateRecordsResponse class];
+        AWSJSONResponseSerializer *serializer = [[NSClassFromString(@"AWSCognitoSyncResponseSerializer") alloc] initWithJSONDefinition:[[AWSCognitoSyncResources sharedInstance] JSONObject]
+                                                                                                                            actionName:operationName
+                                                                                                                           outputClass:outputClass];
+
+        NSError *error = nil;
+        NSDate *start = [NSDate date];
+        id decoded = [serializer responseObjectForResponse:response originalRequest:nil currentRequest:nil data:data error:&error];
+        NSTimeInterval decodeTime = -[start timeIntervalSinceNow];
+        XCTAssertNil(error);
+
+        start = [NSDate date];
+        id adapted = [AWSMTLJSONAdapter modelOfClass:outputClass
+                                  fromJSONDictionary:[NSJSONSerialization JSONObjectWithData:data options:0 error:nil]
+                                               error:&error];
+        NSTimeInterval adapterTime = -[start timeIntervalSinceNow];
+        XCTAssertNil(error);
+
+        XCTAssertTrue([decoded isKindOfClass:outputClass]);
+        XCTAssertEqualObjects(decoded, adapted);
+        XCTAssertEqual([[decoded records] count], (NSUInteger)1000);
+
+        NSLog(@"%@ page of %lu bytes: direct %8.2fms, model adapter %8.2fms", operationName, (unsigned long)[data length], decodeTime * 1000.0, adapterTime * 1000.0);
+    }
+}
+
+
+- (NSData *)gunzipData:(NSData *)data {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    XCTAssertEqual(inflateInit2(&stream, MAX_WBITS + 16), Z_OK);
+    NSMutableData *inflated = [NSMutableData dataWithLength:[data length] * 20];
+    stream.next_in = (Bytef *)[data bytes];
+    stream.avail_in = (uInt)[data length];
+    stream.next_out = [inflated mutableBytes];
+    stream.avail_out = (uInt)[inflated length];
+    int status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    XCTAssertEqual(status, Z_STREAM_END);
+    [inflated setLength:stream.total_out];
+    return inflated;
+}
+
+- (void)testRequestCompression {
+    NSString *key = @"testRequestCompression";
+    AWSServiceConfiguration *configuration = [[AWSServiceConfiguration alloc] initWithRegion:AWSRegionUSEast1 credentialsProvider:nil];
+    [AWSCognitoSync registerCognitoSyncWithConfiguration:configuration forKey:key];
+    AWSCognitoSync *awsClient = [AWSCognitoSync CognitoSyncForKey:key];
+    XCTAssertEqual(awsClient.requestCompressionThreshold, (NSUInteger)0);
+
+    // the compressor sits between the user agent interceptor and the signer
+    NSArray *interceptors = awsClient.configuration.requestInterceptors;
+    XCTAssertEqual([interceptors count], (NSUInteger)3);
+    id<AWSNetworkingRequestInterceptor> compressor = interceptors[1];
+    XCTAssertTrue([interceptors[2] isKindOfClass:[AWSSignatureV4Signer class]]);
+
+    // an UpdateRecords body pushing 500 changes
+    NSMutableArray *patches = [NSMutableArray arrayWithCapacity:500];
+    for (int i = 0; i < 500; i++) {
+        [patches addObject:@{@"Op" : @"replace",
+                             @"Key" : [NSString stringWithFormat:@"setting%d", i],
+                             @"Value" : [NSString stringWithFormat:@"{\"level\":%d,\"score\":%d,\"unlocked\":true}", i % 40, i * 37],
+                             @"SyncCount" : @(i)}];
+    }
+    NSData *body = [NSJSONSerialization dataWithJSONObject:@{@"RecordPatches" : patches, @"SyncSessionToken" : @"session"} options:0 error:nil];
+
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://cognito-sync.us-east-1.amazonaws.com/"]];
+    request.HTTPBody = body;
+    [[compressor interceptRequest:request] waitUntilFinished];
+    XCTAssertEqualObjects(request.HTTPBody, body, @"Compression should be off by default");
+    XCTAssertNil([request valueForHTTPHeaderField:@"Content-Encoding"]);
+
+    awsClient.requestCompressionThreshold = [body length] + 1;
+    [[compressor interceptRequest:request] waitUntilFinished];
+    XCTAssertEqualObjects(request.HTTPBody, body, @"Bodies under the threshold should be sent as they are");
+
+    awsClient.requestCompressionThreshold = 1024;
+    NSDate *start = [NSDate date];
+    [[compressor interceptRequest:request] waitUntilFinished];
+    NSTimeInterval compressTime = -[start timeIntervalSinceNow];
+    XCTAssertEqualObjects([request valueForHTTPHeaderField:@"Content-Encoding"], @"gzip");
+    XCTAssertTrue([request.HTTPBody length] < [body length]);
+    XCTAssertEqualObjects([self gunzipData:request.HTTPBody], body);
+
+    // a body that is already encoded is left alone
+    NSData *compressed = request.HTTPBody;
+    [[compressor interceptRequest:request] waitUntilFinished];
+    XCTAssertEqualObjects(request.HTTPBody, compressed);
+
+    NSLog(@"UpdateRecords of 500 patches: %lu bytes, %lu bytes gzip compressed in %8.2fms", (unsigned long)[body length], (unsigned long)[compressed length], compressTime * 1000.0);
+
+    [AWSCognitoSync removeCognitoSyncForKey:key];
+}
+
+
+- (void)testMetricsDelegateReceivesEveryCall {
+    NSString *key = @"testMetricsDelegateReceivesEveryCall";
+    AWSServiceConfiguration *configuration = [[AWSServiceConfiguration alloc] initWithRegion:AWSRegionUSEast1 credentialsProvider:nil];
+    [AWSCognitoSync registerCognitoSyncWithConfiguration:configuration forKey:key];
+    AWSCognitoSync *awsClient = [AWSCognitoSync CognitoSyncForKey:key];
+
+    AWSGeneralCognitoSyncTestsEndpoint *endpoint = [[AWSGeneralCognitoSyncTestsEndpoint alloc] initWithConfiguration:awsClient.configuration];
+    endpoint.responseData = [self recordPageOfSize:100];
+    endpoint.latency = 20;
+    [awsClient setValue:endpoint forKey:@"networking"];
+
+    AWSCognitoSyncMetricsCollector *collector = [AWSCognitoSyncMetricsCollector new];
+    awsClient.metricsDelegate = collector;
+
+    AWSCognitoSyncListRecordsRequest *request = [AWSCognitoSyncListRecordsRequest new];
+    request.identityPoolId = @"us-east-1:11111111-1111-1111-1111-111111111111";
+    request.identityId = @"us-east-1:22222222-2222-2222-2222-222222222222";
+    request.datasetName = @"metrics";
+
+    for (int i = 0; i < 10; i++) {
+        AWSTask *task = [awsClient listRecords:request];
+        [task waitUntilFinished];
+        XCTAssertNil(task.error, @"listRecords failed [%@]", task.error);
+        XCTAssertEqual([[task.result records] count], (NSUInteger)100);
+    }
+
+    // two throttled attempts, then success
+    endpoint.throttledAttempts = 2;
+    [[awsClient listRecords:request] waitUntilFinished];
+
+    // one throttled attempt of another operation
+    endpoint.throttledAttempts = 1;
+    endpoint.responseData = [@"{}" dataUsingEncoding:NSUTF8StringEncoding];
+    AWSCognitoSyncDescribeDatasetRequest *describe = [AWSCognitoSyncDescribeDatasetRequest new];
+    describe.identityPoolId = request.identityPoolId;
+    describe.identityId = request.identityId;
+    describe.datasetName = request.datasetName;
+    [[awsClient describeDataset:describe] waitUntilFinished];
+
+    AWSCognitoSyncOperationStatistics *listRecords = [collector statisticsForOperation:@"ListRecords"];
+    XCTAssertEqual(listRecords.calls, (NSUInteger)11);
+    XCTAssertEqual(listRecords.retries, (NSUInteger)2);
+    XCTAssertEqual([listRecords.errorCounts count], (NSUInteger)0);
+    XCTAssertEqual(listRecords.responseBytes, (unsigned long long)[[self recordPageOfSize:100] length] * 11);
+    XCTAssertTrue(listRecords.requestBytes > 0);
+    NSUInteger histogramTotal = 0;
+    for (NSNumber *count in listRecords.durationHistogram) {
+        histogramTotal += [count unsignedIntegerValue];
+    }
+    XCTAssertEqual(histogramTotal, (NSUInteger)11);
+    XCTAssertTrue([listRecords durationPercentile:0.5] >= 0.016, @"Calls took at least the endpoint latency");
+
+    AWSCognitoSyncOperationStatistics *describeDataset = [collector statisticsForOperation:@"DescribeDataset"];
+    XCTAssertEqual(describeDataset.calls, (NSUInteger)1);
+    XCTAssertEqual(describeDataset.retries, (NSUInteger)1);
+    XCTAssertNil([collector statisticsForOperation:@"UpdateRecords"]);
+
+    NSLog(@"ListRecords: %lu calls, p50 %.0fms, p99 %.0fms, %llu bytes received", (unsigned long)listRecords.calls, [listRecords durationPercentile:0.5] * 1000, [listRecords durationPercentile:0.99] * 1000, listRecords.responseBytes);
+
+    [collector reset];
+    XCTAssertNil([collector statisticsForOperation:@"ListRecords"]);
+
+    [AWSCognitoSync removeCognitoSyncForKey:key];
+}
+
+- (void)testMetricsReportFailedCalls {
+    NSString *key = @"testMetricsReportFailedCalls";
+    AWSServiceConfiguration *configuration = [[AWSServiceConfiguration alloc] initWithRegion:AWSRegionUSEast1 credentialsProvider:nil];
+    [AWSCognitoSync registerCognitoSyncWithConfiguration:configuration forKey:key];
+    AWSCognitoSync *awsClient = [AWSCognitoSync CognitoSyncForKey:key];
+    [awsClient setValue:mockNetworking forKey:@"networking"];
+
+    AWSCognitoSyncMetricsCollector *collector = [AWSCognitoSyncMetricsCollector new];
+    awsClient.metricsDelegate = collector;
+    [[awsClient updateRecords:[AWSCognitoSyncUpdateRecordsRequest new]] waitUntilFinished];
+
+    AWSCognitoSyncOperationStatistics *updateRecords = [collector statisticsForOperation:@"UpdateRecords"];
+    XCTAssertEqual(updateRecords.calls, (NSUInteger)1);
+    XCTAssertEqualObjects(updateRecords.errorCounts, @{@"OCMockExpectedNetworkingError:8848" : @1});
+    XCTAssertEqual(updateRecords.responseBytes, (unsigned long long)0);
+
+    [AWSCognitoSync removeCognitoSyncForKey:key];
+}
+
 @end
@@ -21,6 +21,15 @@
 #import <XCTest/XCTest.h>
 #import "AWSCognito.h"
 #import "AWSCognitoConflict_Internal.h"
+#import "AWSCognitoConstants.h"
+#import <sqlite3.h>
+#import <malloc/malloc.h>
+
+@interface AWSCognitoSQLiteManager (AmazonCognitoSqliteManagerTests)
+
+- (NSString *)filePath;
+
+@end
 
 @interface AmazonCognitoSqliteManagerTests : XCTestCase
 
@@ -235,6 +244,660 @@ NSString *const DatasetName = @"testDataset";
         XCTAssertTrue(reset.syncCount == 0, @"record sync count not reset");
     }
 }
+
+- (void)testGetRecordsByIds {
+    NSError * error;
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:on] datasetName:DatasetName error:&error];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"rememberme" data:on] datasetName:DatasetName error:&error];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"other" data:on] datasetName:@"otherDataset" error:&error];
+    XCTAssertNil(error, @"Error on put [%@]", error);
+
+    NSDictionary *records = [self.manager getRecordsByIds:@[@"wifi", @"rememberme", @"other", @"missing"] datasetName:DatasetName error:&error];
+    XCTAssertNil(error, @"Error on bulk get [%@]", error);
+    XCTAssertEqual([records count], (NSUInteger)2);
+    XCTAssertEqualObjects([[records objectForKey:@"wifi"] data].string, @"on");
+    XCTAssertTrue([[records objectForKey:@"rememberme"] isDirty]);
+    XCTAssertNil([records objectForKey:@"other"]);
+}
+
+- (void)testMigrateJsonRecordValues {
+    NSError * error;
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:on] datasetName:DatasetName error:&error];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"gone" data:on] datasetName:DatasetName error:&error];
+    [self.manager flagRecordAsDeletedById:@"gone" datasetName:DatasetName error:&error];
+    XCTAssertNil(error, @"Error on put [%@]", error);
+
+    // rewrite the rows the way the JSON storage format left them
+    sqlite3 *sqlite = NULL;
+    XCTAssertEqual(sqlite3_open([[self.manager filePath] UTF8String], &sqlite), SQLITE_OK);
+    XCTAssertEqual(sqlite3_exec(sqlite, "UPDATE CognitoData SET Data = '{\"v\":\"on\"}' WHERE Key = 'wifi'", NULL, NULL, NULL), SQLITE_OK);
+    XCTAssertEqual(sqlite3_exec(sqlite, "UPDATE CognitoData SET Data = '{\"v\":\"\\u0000\"}' WHERE Key = 'gone'", NULL, NULL, NULL), SQLITE_OK);
+    XCTAssertEqual(sqlite3_exec(sqlite, "PRAGMA user_version = 0", NULL, NULL, NULL), SQLITE_OK);
+
+    AWSCognitoSQLiteManager *migrated = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:TestId1 deviceId:DeviceId];
+
+    AWSCognitoRecord *record = [migrated getRecordById:@"wifi" datasetName:DatasetName error:&error];
+    XCTAssertEqualObjects(record.data.string, @"on");
+    XCTAssertTrue(record.isDirty, @"Migration should not change record metadata");
+    record = [migrated getRecordById:@"gone" datasetName:DatasetName error:&error];
+    XCTAssertTrue([record isDeleted], @"Deleted record should stay deleted");
+
+    sqlite3_stmt *statement = NULL;
+    XCTAssertEqual(sqlite3_prepare_v2(sqlite, "SELECT Data FROM CognitoData WHERE Key = 'wifi'", -1, &statement, NULL), SQLITE_OK);
+    XCTAssertEqual(sqlite3_step(statement), SQLITE_ROW);
+    XCTAssertEqualObjects([NSString stringWithUTF8String:(const char *)sqlite3_column_text(statement, 0)], @"on");
+    sqlite3_finalize(statement);
+
+    XCTAssertEqual(sqlite3_prepare_v2(sqlite, "PRAGMA user_version", -1, &statement, NULL), SQLITE_OK);
+    XCTAssertEqual(sqlite3_step(statement), SQLITE_ROW);
+    XCTAssertEqual(sqlite3_column_int(statement, 0), AWSCognitoSQLiteSchemaVersion);
+    sqlite3_finalize(statement);
+    sqlite3_close(sqlite);
+}
+
+- (void)testRecordValueRoundTrip {
+    NSError * error;
+    NSArray *values = @[@"", @"plain", @"quotes \" and \\ backslashes", @"unicode \u00e9\u6f22\U0001F600", @"{\"v\":\"json-looking\"}"];
+    for (NSUInteger i = 0; i < [values count]; i++) {
+        NSString *key = [NSString stringWithFormat:@"value%lu", (unsigned long)i];
+        AWSCognitoRecordValue *value = [[AWSCognitoRecordValue alloc] initWithString:values[i]];
+        [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:key data:value] datasetName:DatasetName error:&error];
+        XCTAssertNil(error, @"Error on put [%@]", error);
+        XCTAssertEqualObjects([self.manager getRecordById:key datasetName:DatasetName error:&error].data.string, values[i]);
+    }
+}
+
+- (void)assertLocalCounters:(AWSCognitoSQLiteManager *)manager datasetName:(NSString *)datasetName records:(int)records bytes:(long long)bytes {
+    NSError * error;
+    XCTAssertEqual([[manager numRecords:datasetName] intValue], records);
+    XCTAssertEqual([[manager localDataStorage:datasetName] longLongValue], bytes);
+    XCTAssertTrue([manager verifyLocalCounters:datasetName error:&error], @"Local counters out of date [%@]", error);
+}
+
+- (void)testLocalCountersTrackLocalWrites {
+    NSError * error;
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:0 bytes:0];
+
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:on] datasetName:DatasetName error:&error];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"caf\u00e9" data:on] datasetName:DatasetName error:&error];
+    XCTAssertNil(error, @"Error on put [%@]", error);
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:2 bytes:6 + 7];
+
+    // replacing a record swaps its size instead of adding another record
+    AWSCognitoRecordValue* off = [[AWSCognitoRecordValue alloc] initWithString:@"off"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:off] datasetName:DatasetName error:&error];
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:2 bytes:7 + 7];
+
+    // a deleted record only counts its key until it is removed
+    [self.manager flagRecordAsDeletedById:@"wifi" datasetName:DatasetName error:&error];
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:2 bytes:4 + 7];
+    [self.manager deleteRecordById:@"wifi" datasetName:DatasetName error:&error];
+    XCTAssertNil(error, @"Error on delete [%@]", error);
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:1 bytes:7];
+
+    // the counters survive sync count updates and are cleared with the dataset
+    [self.manager updateLastSyncCount:DatasetName syncCount:[NSNumber numberWithInt:3] lastModifiedBy:@"me"];
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:1 bytes:7];
+    [self.manager deleteDataset:DatasetName error:&error];
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:0 bytes:0];
+}
+
+- (void)testLocalCountersTrackRemoteChanges {
+    NSError * error;
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    AWSCognitoRecord* local = [[AWSCognitoRecord alloc] initWithId:@"wifi" data:on];
+    [self.manager putRecord:local datasetName:DatasetName error:&error];
+    local = [self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error];
+
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:2];
+    AWSCognitoRecord* remote = [[AWSCognitoRecord alloc] initWithId:@"wifi" data:[[AWSCognitoRecordValue alloc] initWithString:@"remote"]];
+    remote.syncCount = 1;
+    remote.lastModifiedBy = @"remote";
+    [records addObject:[[AWSCognitoRecordTuple alloc] initWithLocalRecord:local remoteRecord:remote]];
+    remote = [[AWSCognitoRecord alloc] initWithId:@"rememberme" data:on];
+    remote.syncCount = 1;
+    remote.lastModifiedBy = @"remote";
+    [records addObject:[[AWSCognitoRecordTuple alloc] initWithLocalRecord:nil remoteRecord:remote]];
+
+    XCTAssertTrue([self.manager updateWithRemoteChanges:DatasetName nonConflicts:records resolvedConflicts:nil error:&error], @"Error on merge [%@]", error);
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:2 bytes:10 + 12];
+}
+
+- (void)testLocalCountersFollowReparent {
+    NSError * error;
+    AWSCognitoSQLiteManager *managerForOther = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:TestId2 deviceId:DeviceId];
+    [managerForOther initializeDatasetTables:DatasetName];
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    [managerForOther putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:on] datasetName:DatasetName error:&error];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"rememberme" data:on] datasetName:DatasetName error:&error];
+
+    [managerForOther reparentDatasets:TestId2 withNewId:TestId1 error:&error];
+    XCTAssertNil(error, @"Error on reparent [%@]", error);
+
+    NSString *mergedName = [NSString stringWithFormat:@"%@.%@", DatasetName, TestId2];
+    [self assertLocalCounters:managerForOther datasetName:DatasetName records:0 bytes:0];
+    [self assertLocalCounters:self.manager datasetName:mergedName records:1 bytes:6];
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:1 bytes:12];
+}
+
+- (void)testRepairLocalCounters {
+    NSError * error;
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:on] datasetName:DatasetName error:&error];
+
+    sqlite3 *sqlite = NULL;
+    XCTAssertEqual(sqlite3_open([[self.manager filePath] UTF8String], &sqlite), SQLITE_OK);
+    XCTAssertEqual(sqlite3_exec(sqlite, "UPDATE CognitoMetadata SET LocalRecordCount = 7, LocalDataStorage = 7", NULL, NULL, NULL), SQLITE_OK);
+    sqlite3_close(sqlite);
+
+    XCTAssertFalse([self.manager verifyLocalCounters:DatasetName error:&error], @"Stale counters not detected");
+    XCTAssertNotNil(error);
+    error = nil;
+    XCTAssertTrue([self.manager repairLocalCounters:&error], @"Error on repair [%@]", error);
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:1 bytes:6];
+}
+
+#pragma mark - Schema migrations
+
+/**
+ * Replaces the database with one in the schema first shipped, at the given user_version,
+ * filled by the given statements.
+ **/
+- (void)createFixtureAtVersion:(int)version statements:(NSArray *)statements {
+    NSString *filePath = [self.manager filePath];
+    [self.manager deleteSQLiteDatabase];
+    self.manager = nil;
+
+    NSArray *schema = @[@"CREATE TABLE CognitoData (IdentityId TEXT NOT NULL DEFAULT UnknownId, Dataset TEXT NOT NULL, Key TEXT NOT NULL, LastModified INTEGER NOT NULL, ModifiedBy TEXT NOT NULL, Data TEXT NOT NULL, SyncCount INTEGER NOT NULL DEFAULT 0, Dirty INTEGER NOT NULL DEFAULT 1, Type INTEGER NOT NULL, PRIMARY KEY(IdentityId,Dataset,Key))",
+                        @"CREATE TABLE CognitoMetadata (IdentityId TEXT NOT NULL DEFAULT UnknownId, Dataset TEXT NOT NULL, LastSyncCount INTEGER NOT NULL DEFAULT 0, LastModified INTEGER NOT NULL DEFAULT 0, ModifiedBy TEXT NOT NULL, CreationDate INTEGER NOT NULL DEFAULT 0, DataStorage INTEGER NOT NULL DEFAULT 0, RecordCount INTEGER NOT NULL DEFAULT 0, PRIMARY KEY(IdentityId,Dataset))",
+                        [NSString stringWithFormat:@"PRAGMA user_version = %d", version]];
+    sqlite3 *sqlite = NULL;
+    XCTAssertEqual(sqlite3_open([filePath UTF8String], &sqlite), SQLITE_OK);
+    for (NSString *sqlString in [schema arrayByAddingObjectsFromArray:statements]) {
+        XCTAssertEqual(sqlite3_exec(sqlite, [sqlString UTF8String], NULL, NULL, NULL), SQLITE_OK, @"%@", sqlString);
+    }
+    sqlite3_close(sqlite);
+}
+
+- (int)schemaVersion {
+    sqlite3 *sqlite = NULL;
+    sqlite3_stmt *statement = NULL;
+    int version = -1;
+    XCTAssertEqual(sqlite3_open([[self.manager filePath] UTF8String], &sqlite), SQLITE_OK);
+    if (sqlite3_prepare_v2(sqlite, "PRAGMA user_version", -1, &statement, NULL) == SQLITE_OK && sqlite3_step(statement) == SQLITE_ROW) {
+        version = sqlite3_column_int(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    sqlite3_close(sqlite);
+    return version;
+}
+
+- (void)testMigrateOriginalSchema {
+    NSError * error;
+    [self createFixtureAtVersion:0 statements:@[
+        @"INSERT INTO CognitoMetadata (IdentityId, Dataset, LastSyncCount, ModifiedBy) VALUES ('originalId', 'testDataset', 4, 'tester')",
+        @"INSERT INTO CognitoData (IdentityId, Dataset, Key, LastModified, ModifiedBy, Data, SyncCount, Dirty, Type) VALUES ('originalId', 'testDataset', 'wifi', 0, 'tester', '{\"v\":\"on\"}', 3, 0, 1)",
+        @"INSERT INTO CognitoData (IdentityId, Dataset, Key, LastModified, ModifiedBy, Data, SyncCount, Dirty, Type) VALUES ('originalId', 'testDataset', 'volume', 0, 'tester', '{\"v\":\"11\"}', 4, 2, 1)",
+        @"INSERT INTO CognitoData (IdentityId, Dataset, Key, LastModified, ModifiedBy, Data, SyncCount, Dirty, Type) VALUES ('originalId', 'testDataset', 'gone', 0, 'tester', '{\"v\":\"\\u0000\"}', 1, -1, 2)"]];
+
+    self.manager = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:TestId1 deviceId:DeviceId];
+    XCTAssertEqual([self schemaVersion], AWSCognitoSQLiteSchemaVersion);
+
+    XCTAssertEqualObjects([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error].data.string, @"on");
+    XCTAssertEqualObjects([self.manager getRecordById:@"volume" datasetName:DatasetName error:&error].data.string, @"11");
+    XCTAssertTrue([[self.manager getRecordById:@"gone" datasetName:DatasetName error:&error] isDeleted]);
+    XCTAssertEqualObjects([self.manager lastSyncCount:DatasetName], @4);
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:3 bytes:6 + 8 + 4];
+
+    NSDictionary *dirty = [self.manager recordsUpdatedAfterLastSync:DatasetName error:&error];
+    XCTAssertEqual([dirty count], (NSUInteger)2);
+    XCTAssertNil([dirty objectForKey:@"wifi"]);
+
+    // the triggers are in place for writes after the migration
+    AWSCognitoRecordValue* off = [[AWSCognitoRecordValue alloc] initWithString:@"off"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:off] datasetName:DatasetName error:&error];
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:3 bytes:7 + 8 + 4];
+}
+
+- (void)testMigrateResumesFromIntermediateVersion {
+    NSError * error;
+    // raw values are already in place, the later steps have not run
+    [self createFixtureAtVersion:AWSCognitoSQLiteRawValueFormatVersion statements:@[
+        @"INSERT INTO CognitoData (IdentityId, Dataset, Key, LastModified, ModifiedBy, Data, SyncCount, Dirty, Type) VALUES ('originalId', 'testDataset', 'wifi', 0, 'tester', 'on', 0, 1, 1)",
+        @"INSERT INTO CognitoData (IdentityId, Dataset, Key, LastModified, ModifiedBy, Data, SyncCount, Dirty, Type) VALUES ('originalId', 'orphan', 'wifi', 0, 'tester', 'on', 0, 1, 1)"]];
+
+    self.manager = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:TestId1 deviceId:DeviceId];
+    XCTAssertEqual([self schemaVersion], AWSCognitoSQLiteSchemaVersion);
+    XCTAssertEqualObjects([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error].data.string, @"on");
+
+    // records without a metadata row get their counters once the dataset is opened
+    [self.manager initializeDatasetTables:DatasetName];
+    [self assertLocalCounters:self.manager datasetName:DatasetName records:1 bytes:6];
+    [self.manager updateLastSyncCount:@"orphan" syncCount:@1 lastModifiedBy:nil];
+    [self assertLocalCounters:self.manager datasetName:@"orphan" records:1 bytes:6];
+}
+
+- (void)testNewerSchemaIsLeftAlone {
+    [self createFixtureAtVersion:AWSCognitoSQLiteSchemaVersion + 1 statements:@[]];
+    self.manager = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:TestId1 deviceId:DeviceId];
+    XCTAssertEqual([self schemaVersion], AWSCognitoSQLiteSchemaVersion + 1);
+}
+
+- (AWSCognitoSyncDataset *)remoteDataset:(NSString *)datasetName lastModified:(NSTimeInterval)lastModified {
+    AWSCognitoSyncDataset *dataset = [AWSCognitoSyncDataset new];
+    dataset.datasetName = datasetName;
+    dataset.lastModifiedDate = [NSDate dateWithTimeIntervalSince1970:lastModified];
+    dataset.lastModifiedBy = @"remote";
+    dataset.dataStorage = @10;
+    dataset.numRecords = @1;
+    return dataset;
+}
+
+- (void)testPullStateFollowsDatasetListing {
+    NSError * error;
+    BOOL pulled = YES;
+    XCTAssertEqualObjects([self.manager remoteLastModified:DatasetName pulled:&pulled], @0);
+    XCTAssertFalse(pulled, @"Nothing is known about the remote dataset yet");
+
+    XCTAssertTrue([self.manager putDatasetMetadata:@[[self remoteDataset:DatasetName lastModified:1000]] error:&error]);
+    NSNumber *remoteLastModified = [self.manager remoteLastModified:DatasetName pulled:&pulled];
+    XCTAssertEqualObjects(remoteLastModified, @1000000);
+    XCTAssertFalse(pulled);
+
+    [self.manager updatePulledLastModified:DatasetName lastModified:remoteLastModified];
+    [self.manager updateLastSyncCount:DatasetName syncCount:@5 lastModifiedBy:nil];
+    XCTAssertEqualObjects([self.manager remoteLastModified:DatasetName pulled:&pulled], @1000000, @"Updating the sync count should keep the remote metadata");
+    XCTAssertTrue(pulled);
+
+    // the remote dataset changed after the pull
+    [self.manager putDatasetMetadata:@[[self remoteDataset:DatasetName lastModified:2000]] error:&error];
+    XCTAssertEqualObjects([self.manager remoteLastModified:DatasetName pulled:&pulled], @2000000);
+    XCTAssertFalse(pulled);
+    [self.manager updatePulledLastModified:DatasetName lastModified:@2000000];
+    [self.manager remoteLastModified:DatasetName pulled:&pulled];
+    XCTAssertTrue(pulled);
+
+    // the remote dataset is no longer listed
+    [self.manager putDatasetMetadata:@[[self remoteDataset:@"other" lastModified:1000]] error:&error];
+    [self.manager remoteLastModified:DatasetName pulled:&pulled];
+    XCTAssertFalse(pulled);
+}
+
+- (void)testDirtyRecordScanUsesIndex {
+    if (sqlite3_libversion_number() < 3008000) {
+        NSLog(@"Skipping, SQLite %s has no partial indexes", sqlite3_libversion());
+        return;
+    }
+
+    sqlite3 *sqlite = NULL;
+    XCTAssertEqual(sqlite3_open([[self.manager filePath] UTF8String], &sqlite), SQLITE_OK);
+    sqlite3_stmt *statement = NULL;
+    const char *plan = "EXPLAIN QUERY PLAN SELECT Key, LastModified, ModifiedBy, Data, Type, SyncCount, Dirty FROM CognitoData WHERE Dirty != 0 AND IdentityId = ? AND Dataset = ?";
+    XCTAssertEqual(sqlite3_prepare_v2(sqlite, plan, -1, &statement, NULL), SQLITE_OK);
+    NSMutableString *details = [NSMutableString string];
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+        [details appendFormat:@"%s\n", sqlite3_column_text(statement, 3)];
+    }
+    sqlite3_finalize(statement);
+    sqlite3_close(sqlite);
+    XCTAssertTrue([details rangeOfString:@"CognitoDataDirty"].location != NSNotFound, @"Dirty records are scanned without the index: %@", details);
+}
+
+- (void)testRecordCacheFollowsLocalWrites {
+    NSError * error;
+    [self.manager enableRecordCache:16];
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:on] datasetName:DatasetName error:&error];
+
+    XCTAssertNil([self.manager getRecordById:@"missing" datasetName:DatasetName error:&error]);
+    XCTAssertEqualObjects([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error].data.string, @"on");
+    XCTAssertEqualObjects([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error].data.string, @"on");
+    XCTAssertNil([self.manager getRecordById:@"missing" datasetName:DatasetName error:&error]);
+    XCTAssertEqual(self.manager.recordCacheMisses, (NSUInteger)2);
+    XCTAssertEqual(self.manager.recordCacheHits, (NSUInteger)2);
+
+    // changing a returned record must not change the cached one
+    [self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error].data = [[AWSCognitoRecordValue alloc] initWithString:@"changed"];
+    XCTAssertEqualObjects([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error].data.string, @"on");
+
+    AWSCognitoRecordValue* off = [[AWSCognitoRecordValue alloc] initWithString:@"off"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:off] datasetName:DatasetName error:&error];
+    [self.manager putRecords:@[[[AWSCognitoRecord alloc] initWithId:@"missing" data:on]] datasetName:DatasetName error:&error];
+    XCTAssertNil(error, @"Error on put [%@]", error);
+
+    // the cached copies match what an uncached manager reads from the database
+    AWSCognitoSQLiteManager *uncached = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:TestId1 deviceId:DeviceId];
+    NSUInteger hits = self.manager.recordCacheHits;
+    for (NSString *key in @[@"wifi", @"missing"]) {
+        AWSCognitoRecord *cached = [self.manager getRecordById:key datasetName:DatasetName error:&error];
+        AWSCognitoRecord *stored = [uncached getRecordById:key datasetName:DatasetName error:&error];
+        XCTAssertEqualObjects(cached.data.string, stored.data.string);
+        XCTAssertEqual(cached.dirtyCount, stored.dirtyCount);
+        XCTAssertEqual(cached.syncCount, stored.syncCount);
+        XCTAssertEqualObjects(cached.lastModifiedBy, stored.lastModifiedBy);
+        XCTAssertEqualObjects(cached.lastModified, stored.lastModified);
+    }
+    XCTAssertEqual(self.manager.recordCacheHits, hits + 2);
+
+    [self.manager flagRecordAsDeletedById:@"wifi" datasetName:DatasetName error:&error];
+    XCTAssertTrue([[self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error] isDeleted]);
+    [self.manager deleteRecordById:@"wifi" datasetName:DatasetName error:&error];
+    XCTAssertNil([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error]);
+}
+
+- (void)testRecordCacheInvalidation {
+    NSError * error;
+    [self.manager enableRecordCache:16];
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:@"wifi" data:on] datasetName:DatasetName error:&error];
+    AWSCognitoRecord *local = [self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error];
+
+    // remote changes
+    AWSCognitoRecord* remote = [[AWSCognitoRecord alloc] initWithId:@"wifi" data:[[AWSCognitoRecordValue alloc] initWithString:@"remote"]];
+    remote.syncCount = 1;
+    remote.lastModifiedBy = @"remote";
+    XCTAssertTrue([self.manager updateWithRemoteChanges:DatasetName nonConflicts:@[[[AWSCognitoRecordTuple alloc] initWithLocalRecord:local remoteRecord:remote]] resolvedConflicts:nil error:&error]);
+    local = [self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error];
+    XCTAssertEqualObjects(local.data.string, @"remote");
+    XCTAssertEqual(local.syncCount, (int64_t)1);
+
+    // pushed records
+    AWSCognitoRecord *pushed = [local copy];
+    pushed.syncCount = 2;
+    pushed.dirtyCount = 0;
+    XCTAssertTrue([self.manager updateLocalRecordMetadata:DatasetName records:@[[[AWSCognitoRecordTuple alloc] initWithLocalRecord:local remoteRecord:pushed]] error:&error]);
+    XCTAssertEqual([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error].syncCount, (int64_t)2);
+
+    // reparenting
+    [self.manager reparentDatasets:TestId1 withNewId:TestId2 error:&error];
+    XCTAssertNil(error, @"Error on reparent [%@]", error);
+    XCTAssertNil([self.manager getRecordById:@"wifi" datasetName:DatasetName error:&error]);
+    self.manager.identityId = TestId2;
+    NSString *mergedName = [NSString stringWithFormat:@"%@.%@", DatasetName, TestId1];
+    XCTAssertEqualObjects([self.manager getRecordById:@"wifi" datasetName:mergedName error:&error].data.string, @"remote");
+
+    // deleting the dataset
+    [self.manager deleteDataset:mergedName error:&error];
+    XCTAssertNil([self.manager getRecordById:@"wifi" datasetName:mergedName error:&error]);
+}
+
+#pragma mark - Performance
+
+- (void)testGetRecordPerformance {
+    NSError * error;
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    AWSCognitoRecord* record = [[AWSCognitoRecord alloc] initWithId:@"wifi" data:on];
+    [self.manager putRecord:record datasetName:DatasetName error:&error];
+    XCTAssertNil(error, @"Error on put [%@]", error);
+
+    [self measureBlock:^{
+        for (int i = 0; i < 1000; i++) {
+            [self.manager getRecordById:@"wifi" datasetName:DatasetName error:nil];
+        }
+    }];
+}
+
+- (void)testCachedGetRecordPerformance {
+    NSError * error;
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    NSArray *keys = @[@"wifi", @"rememberme", @"volume", @"level", @"missing"];
+    for (NSString *key in keys) {
+        [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:key data:on] datasetName:DatasetName error:&error];
+    }
+    XCTAssertNil(error, @"Error on put [%@]", error);
+    [self.manager enableRecordCache:16];
+
+    [self measureBlock:^{
+        for (int i = 0; i < 1000; i++) {
+            [self.manager getRecordById:keys[i % [keys count]] datasetName:DatasetName error:nil];
+        }
+    }];
+    NSLog(@"Record cache: %lu hits, %lu misses", (unsigned long)self.manager.recordCacheHits, (unsigned long)self.manager.recordCacheMisses);
+}
+
+- (void)testPushPreparationTimings {
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    sqlite3 *sqlite = NULL;
+    XCTAssertEqual(sqlite3_open([[self.manager filePath] UTF8String], &sqlite), SQLITE_OK);
+
+    for (NSNumber *size in @[@100, @1000, @10000]) {
+        NSString *datasetName = [NSString stringWithFormat:@"push%@", size];
+        NSMutableArray *records = [NSMutableArray arrayWithCapacity:[size unsignedIntegerValue]];
+        for (NSUInteger i = 0; i < [size unsignedIntegerValue]; i++) {
+            [records addObject:[[AWSCognitoRecord alloc] initWithId:[NSString stringWithFormat:@"key%lu", (unsigned long)i] data:on]];
+        }
+        XCTAssertTrue([self.manager putRecords:records datasetName:datasetName error:nil]);
+
+        for (NSNumber *percentDirty in @[@1, @10, @100]) {
+            // mark all but the first percentDirty% of the records as synced
+            NSString *clean = [NSString stringWithFormat:@"UPDATE CognitoData SET Dirty = CASE WHEN rowid %% 100 < %@ THEN 1 ELSE 0 END WHERE Dataset = '%@'", percentDirty, datasetName];
+            XCTAssertEqual(sqlite3_exec(sqlite, [clean UTF8String], NULL, NULL, NULL), SQLITE_OK);
+
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            NSDictionary *dirty = nil;
+            for (int i = 0; i < 10; i++) {
+                dirty = [self.manager recordsUpdatedAfterLastSync:datasetName error:nil];
+            }
+            double elapsed = (CFAbsoluteTimeGetCurrent() - start) * 1000.0 / 10;
+            XCTAssertTrue([dirty count] > 0);
+            NSLog(@"recordsUpdatedAfterLastSync: %@ records, %@%% dirty (%lu): %.3fms", size, percentDirty, (unsigned long)[dirty count], elapsed);
+        }
+    }
+    sqlite3_close(sqlite);
+}
+
+- (void)testPutRecordPerformance {
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+
+    [self measureBlock:^{
+        for (int i = 0; i < 1000; i++) {
+            AWSCognitoRecord* record = [[AWSCognitoRecord alloc] initWithId:[NSString stringWithFormat:@"key%d", i % 100] data:on];
+            [self.manager putRecord:record datasetName:DatasetName error:nil];
+        }
+    }];
+}
+
+- (void)measureRecordValueRoundTripWithLength:(NSUInteger)length {
+    NSString *string = [@"" stringByPaddingToLength:length withString:@"v" startingAtIndex:0];
+    AWSCognitoRecordValue* value = [[AWSCognitoRecordValue alloc] initWithString:string];
+
+    [self measureBlock:^{
+        for (int i = 0; i < 100; i++) {
+            NSString *key = [NSString stringWithFormat:@"key%d", i];
+            [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:key data:value] datasetName:DatasetName error:nil];
+            [self.manager getRecordById:key datasetName:DatasetName error:nil];
+        }
+    }];
+}
+
+- (void)testSmallRecordValuePerformance {
+    [self measureRecordValueRoundTripWithLength:16];
+}
+
+- (void)testMediumRecordValuePerformance {
+    [self measureRecordValueRoundTripWithLength:1024];
+}
+
+- (void)testLargeRecordValuePerformance {
+    [self measureRecordValueRoundTripWithLength:64 * 1024];
+}
+
+- (NSArray *)putPullMergeRecords {
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:1024];
+    for (int i = 0; i < 1024; i++) {
+        NSString *key = [NSString stringWithFormat:@"key%d", i];
+        [self.manager putRecord:[[AWSCognitoRecord alloc] initWithId:key data:on] datasetName:DatasetName error:nil];
+        [keys addObject:key];
+    }
+    return keys;
+}
+
+- (void)testPullMergeLookupPerformance {
+    NSArray *keys = [self putPullMergeRecords];
+
+    [self measureBlock:^{
+        NSMutableDictionary *existing = [NSMutableDictionary dictionaryWithCapacity:[keys count]];
+        for (NSString *key in keys) {
+            AWSCognitoRecord *record = [self.manager getRecordById:key datasetName:DatasetName error:nil];
+            if (record) {
+                [existing setObject:record forKey:key];
+            }
+        }
+        XCTAssertEqual([existing count], [keys count]);
+    }];
+}
+
+- (void)testPullMergeBulkLookupPerformance {
+    NSArray *keys = [self putPullMergeRecords];
+
+    [self measureBlock:^{
+        NSDictionary *existing = [self.manager getRecordsByIds:keys datasetName:DatasetName error:nil];
+        XCTAssertEqual([existing count], [keys count]);
+    }];
+}
+
+- (void)testConcurrentReadLatencyDuringRemoteWrites {
+    NSError * error;
+    AWSCognitoRecordValue* on = [[AWSCognitoRecordValue alloc] initWithString:@"on"];
+    AWSCognitoRecord* record = [[AWSCognitoRecord alloc] initWithId:@"wifi" data:on];
+    [self.manager putRecord:record datasetName:DatasetName error:&error];
+    XCTAssertNil(error, @"Error on put [%@]", error);
+
+    XCTAssertTrue([self.manager enableConcurrentReads:2], @"Unable to enable concurrent reads");
+
+    __block BOOL writing = YES;
+    dispatch_semaphore_t writerDone = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (int round = 0; round < 5; round++) {
+            NSMutableArray *records = [NSMutableArray arrayWithCapacity:1000];
+            for (int i = 0; i < 1000; i++) {
+                AWSCognitoRecord* remote = [[AWSCognitoRecord alloc] initWithId:[NSString stringWithFormat:@"r%d-%d", round, i] data:on];
+                remote.syncCount = 1;
+                remote.lastModifiedBy = @"remote";
+                [records addObject:[[AWSCognitoRecordTuple alloc] initWithLocalRecord:nil remoteRecord:remote]];
+            }
+            [self.manager updateWithRemoteChanges:DatasetName nonConflicts:records resolvedConflicts:nil error:nil];
+        }
+        writing = NO;
+        dispatch_semaphore_signal(writerDone);
+    });
+
+    NSMutableArray *timings = [NSMutableArray array];
+    while (writing) {
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        AWSCognitoRecord *read = [self.manager getRecordById:@"wifi" datasetName:DatasetName error:nil];
+        [timings addObject:@((CFAbsoluteTimeGetCurrent() - start) * 1000.0)];
+        XCTAssertEqualObjects(read.recordId, @"wifi");
+    }
+    dispatch_semaphore_wait(writerDone, DISPATCH_TIME_FOREVER);
+
+    XCTAssertTrue([timings count] > 0, @"No reads were timed");
+    NSArray *sorted = [timings sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger count = [sorted count];
+    NSLog(@"getRecordById during remote writes: %lu reads, p50 %.3fms, p95 %.3fms, p99 %.3fms",
+          (unsigned long)count,
+          [sorted[count / 2] doubleValue],
+          [sorted[MIN(count - 1, count * 95 / 100)] doubleValue],
+          [sorted[MIN(count - 1, count * 99 / 100)] doubleValue]);
+    XCTAssertEqual([[self.manager numRecords:DatasetName] intValue], 5001);
+}
+
+
+- (NSArray *)pulledSyncRecords:(NSUInteger)count {
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        AWSCognitoSyncRecord *record = [AWSCognitoSyncRecord new];
+        record.key = [NSString stringWithFormat:@"pulled%lu", (unsigned long)i];
+        // every tenth record was deleted remotely
+        record.value = i % 10 == 0 ? nil : [NSString stringWithFormat:@"value%lu", (unsigned long)i];
+        record.syncCount = @(i + 1);
+        record.lastModifiedBy = @"remote";
+        record.lastModifiedDate = [NSDate dateWithTimeIntervalSince1970:1460000000 + i];
+        [records addObject:record];
+    }
+    return records;
+}
+
+- (size_t)mallocBlocksInUse {
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(NULL, &statistics);
+    return statistics.blocks_in_use;
+}
+
+- (void)testRemoteRecordsWriteWithoutConversion {
+    NSError *error = nil;
+    NSArray *pulled = [self pulledSyncRecords:1024];
+
+    // the first half already exists locally and is updated, the rest is inserted
+    for (NSUInteger i = 0; i < 512; i++) {
+        AWSCognitoRecord *local = [[AWSCognitoRecord alloc] initWithId:[pulled[i] key] data:[[AWSCognitoRecordValue alloc] initWithString:@"local"]];
+        XCTAssertTrue([self.manager putRecord:local datasetName:DatasetName error:&error], @"Error on put [%@]", error);
+    }
+    NSDictionary *localRecords = [self.manager getRecordsByIds:[pulled valueForKey:@"key"] datasetName:DatasetName error:&error];
+    XCTAssertEqual([localRecords count], (NSUInteger)512);
+
+    XCTAssertTrue([self.manager updateWithRemoteRecords:DatasetName records:pulled localRecords:localRecords resolvedConflicts:nil error:&error], @"Error on merge [%@]", error);
+
+    XCTAssertEqual([[self.manager numRecords:DatasetName] unsignedIntegerValue], (NSUInteger)1024);
+    for (AWSCognitoSyncRecord *remote in pulled) {
+        AWSCognitoRecord *stored = [self.manager getRecordById:remote.key datasetName:DatasetName error:&error];
+        XCTAssertEqual(stored.syncCount, [remote.syncCount longLongValue]);
+        XCTAssertEqualObjects(stored.lastModifiedBy, @"remote");
+        XCTAssertFalse(stored.isDirty);
+        if (remote.value == nil) {
+            XCTAssertTrue([stored isDeleted]);
+        } else {
+            XCTAssertEqualObjects(stored.data.string, remote.value);
+        }
+    }
+
+    // a local change made after the lookup fails the conditional write
+    localRecords = [self.manager getRecordsByIds:@[[pulled[1] key]] datasetName:DatasetName error:&error];
+    AWSCognitoRecord *changed = [[AWSCognitoRecord alloc] initWithId:[pulled[1] key] data:[[AWSCognitoRecordValue alloc] initWithString:@"changed"]];
+    XCTAssertTrue([self.manager putRecord:changed datasetName:DatasetName error:&error]);
+    XCTAssertFalse([self.manager updateWithRemoteRecords:DatasetName records:@[pulled[1]] localRecords:localRecords resolvedConflicts:nil error:&error]);
+    XCTAssertEqualObjects([[self.manager getRecordById:[pulled[1] key] datasetName:DatasetName error:nil] data].string, @"changed");
+}
+
+- (void)testPullWriteAllocations {
+    NSArray *pulled = [self pulledSyncRecords:1024];
+    [self.manager initializeDatasetTables:@"converted"];
+    [self.manager initializeDatasetTables:@"direct"];
+
+    // what syncPull used to allocate for a page: a record, a value and a tuple per row
+    size_t convertedBlocks = 0;
+    @autoreleasepool {
+        size_t before = [self mallocBlocksInUse];
+        NSMutableArray *tuples = [NSMutableArray arrayWithCapacity:[pulled count]];
+        for (AWSCognitoSyncRecord *record in pulled) {
+            AWSCognitoRecord *remote = [[AWSCognitoRecord alloc] initWithId:record.key
+                                                                       data:[[AWSCognitoRecordValue alloc] initWithString:record.value type:record.value ? AWSCognitoRecordValueTypeString : AWSCognitoRecordValueTypeDeleted]];
+            remote.syncCount = [record.syncCount longLongValue];
+            remote.lastModifiedBy = record.lastModifiedBy;
+            remote.lastModified = record.lastModifiedDate;
+            [tuples addObject:[[AWSCognitoRecordTuple alloc] initWithLocalRecord:nil remoteRecord:remote]];
+        }
+        XCTAssertTrue([self.manager updateWithRemoteChanges:@"converted" nonConflicts:tuples resolvedConflicts:nil error:nil]);
+        convertedBlocks = [self mallocBlocksInUse] - before;
+    }
+
+    size_t directBlocks = 0;
+    @autoreleasepool {
+        size_t before = [self mallocBlocksInUse];
+        XCTAssertTrue([self.manager updateWithRemoteRecords:@"direct" records:pulled localRecords:@{} resolvedConflicts:nil error:nil]);
+        directBlocks = [self mallocBlocksInUse] - before;
+    }
+
+    XCTAssertEqual([[self.manager numRecords:@"direct"] unsignedIntegerValue], (NSUInteger)1024);
+    XCTAssertEqualObjects([self.manager localDataStorage:@"direct"], [self.manager localDataStorage:@"converted"]);
+    XCTAssertTrue(directBlocks < convertedBlocks, @"Direct write held %lu blocks, converted %lu", (unsigned long)directBlocks, (unsigned long)convertedBlocks);
+    NSLog(@"1024 pulled records written: converted %lu blocks in use, direct %lu", (unsigned long)convertedBlocks, (unsigned long)directBlocks);
+}
+
 @end
 
 #endif
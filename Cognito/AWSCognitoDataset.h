@@ -88,17 +88,100 @@
  */
 @property (nonatomic, assign) uint32_t synchronizeRetries;
 
+/**
+ The longest, in seconds, that a retry after a conflict may wait before pulling again. Retry n
+ waits a random time between 0 and the smaller of synchronizeRetryMaxDelay and
+ synchronizeRetryBaseDelay * 2^(n-1), so devices that conflicted with each other don't retry in
+ lockstep. Defaults to the value on the AWSCognito client that opened this dataset; 0 retries
+ right away.
+ */
+@property (nonatomic, assign) NSTimeInterval synchronizeRetryBaseDelay;
+
+/**
+ The upper bound, in seconds, on the wait before any retry after a conflict. Defaults to the
+ value on the AWSCognito client that opened this dataset.
+ */
+@property (nonatomic, assign) NSTimeInterval synchronizeRetryMaxDelay;
+
+/**
+ The number of attempts the current or most recent synchronize has made, counting the first
+ one and each retry after a conflict. 0 if this dataset hasn't been synchronized.
+ */
+@property (nonatomic, readonly) uint32_t lastSynchronizeAttempts;
+
+/**
+ The number of pulled records the current or most recent synchronize wrote locally.
+ */
+@property (nonatomic, readonly) NSUInteger lastSynchronizeRecordsWritten;
+
+/**
+ The number of pulled records the current or most recent synchronize didn't need to write
+ because the local record already had the same sync count and value, such as the echo of
+ a record this device pushed.
+ */
+@property (nonatomic, readonly) NSUInteger lastSynchronizeRecordsSkipped;
+
 /**
  Only synchronize if device is on a WiFi network. Defaults to
  to the value on the AWSCognito client that opened this dataset.
  */
 @property (nonatomic, assign) BOOL synchronizeOnWiFiOnly;
 
+/**
+ The maximum number of records to request per page when pulling remote changes. Each page
+ is written locally before the next one is requested. Defaults to the value on the
+ AWSCognito client that opened this dataset; 0 lets the service choose the page size.
+ */
+@property (nonatomic, assign) uint32_t synchronizePageSize;
+
+/**
+ The maximum number of local changes to send per request when pushing. Each batch the service
+ accepts is committed locally before the next one is sent, so a conflict only resends the changes
+ that haven't been accepted yet. Defaults to the value on the AWSCognito client that opened this
+ dataset; 0 sends all local changes in one request.
+ */
+@property (nonatomic, assign) uint32_t synchronizePushBatchSize;
+
+/**
+ Skip the synchronize when there are no local changes and the remote dataset has not changed since it
+ was last pulled, going by the last modified date that refreshDatasetMetadata stored for it. Calling
+ refreshDatasetMetadata once and then synchronizing several datasets only contacts the service for the
+ ones that changed. Defaults to the value on the AWSCognito client that opened this dataset.
+ */
+@property (nonatomic, assign) BOOL synchronizeSkipsUnchangedPull;
+
+/**
+ The number of seconds synchronize waits before starting, so a burst of writes each followed by
+ a call to synchronize becomes a single round trip. Every call made during the wait returns the
+ same AWSTask. Defaults to the value on the AWSCognito client that opened this dataset; 0 starts
+ the synchronize right away.
+ */
+@property (nonatomic, assign) NSTimeInterval synchronizeDebounceInterval;
+
 /**
  Sets a string object for the specified key in the dataset.
  */
 - (void)setString:(NSString *) aString forKey:(NSString *) aKey;
 
+/**
+ Sets several string objects at once. All of the keys are validated first and then
+ written in a single transaction; if any key or value is invalid, nothing is written.
+ 
+ @param strings NSDictionary of NSString keys to NSString values
+ */
+- (void)setStrings:(NSDictionary *) strings;
+
+/**
+ Writes several records at once. All of the records are validated first and then
+ written in a single transaction.
+ 
+ @param records NSArray of AWSCognitoRecord objects
+ @param error set if any record is invalid or the write failed, in which case nothing is written
+ 
+ @return YES if every record was written
+ */
+- (BOOL)putRecords:(NSArray *) records error:(NSError **) error;
+
 /**
  Returns the string associated with the specified key.
  */
@@ -109,6 +192,9 @@
  and attempts to overlay them on the local store.  Then it pushes any local updates to the service.  If at any
  point there is a conflict, conflict resolution is invoked.  No changes are pushed to the service until
  all conflicts are resolved.
+ Calling synchronize while a synchronize is in flight returns the AWSTask of the one in flight. If values
+ were set on this dataset since that one started, a single follow-up synchronize is queued instead and
+ every caller until it starts gets its AWSTask.
  */
 - (AWSTask *)synchronize;
 
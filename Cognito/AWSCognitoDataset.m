@@ -11,7 +11,6 @@
 #import "AWSCognitoConflict_Internal.h"
 #import <AWSCore/AWSLogging.h>
 #import "AWSCognitoRecord.h"
-#import <AWSCore/AWSReachability.h>
 
 @interface AWSCognitoDatasetMetadata()
 
@@ -42,16 +41,35 @@
 
 @end
 
+@interface AWSCognito()
+
++ (BOOL)spendSynchronizeRetry;
++ (void)refundSynchronizeRetry;
+- (void)scheduleSynchronize:(NSString *)datasetName;
+- (BOOL)isReachable:(BOOL)wifiOnly;
+- (void)whenReachable:(BOOL)wifiOnly perform:(dispatch_block_t)block;
+
+@end
+
 @interface AWSCognitoDataset()
 @property (nonatomic, strong) NSString *syncSessionToken;
 @property (nonatomic, strong) AWSCognitoSQLiteManager *sqliteManager;
 
 @property (nonatomic, strong) AWSCognitoSync *cognitoService;
 
-@property (nonatomic, strong) AWSReachability *reachability;
-
 @property (nonatomic, strong) NSNumber *currentSyncCount;
 @property (nonatomic, strong) NSDictionary *records;
+@property (nonatomic, assign) uint32_t lastSynchronizeAttempts;
+@property (nonatomic, assign) NSUInteger lastSynchronizeRecordsWritten;
+@property (nonatomic, assign) NSUInteger lastSynchronizeRecordsSkipped;
+@property (nonatomic, strong) AWSCognito *cognito;
+
+// guarded by @synchronized(self)
+@property (nonatomic, strong) AWSTask *inFlightSyncTask;
+@property (nonatomic, strong) AWSTaskCompletionSource *scheduledSyncSource;
+@property (nonatomic, assign) uint64_t localWriteCount;
+@property (nonatomic, assign) uint64_t syncedLocalWriteCount;
+@property (nonatomic, assign) BOOL waitingForConnectivity;
 @end
 
 @implementation AWSCognitoDataset
@@ -62,14 +80,12 @@
     if(self = [super initWithDatasetName:datasetName dataSource:sqliteManager]) {
         _sqliteManager = sqliteManager;
         _cognitoService = cognitoService;
-        _reachability = [AWSReachability reachabilityWithHostname:@"cognito-sync.us-east-1.amazonaws.com"];
     }
     return self;
 }
 
 -(void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
-    _reachability.reachableBlock = nil;
 }
 
 #pragma mark - CRUD operations
@@ -94,7 +110,8 @@
 - (void)setString:(NSString *)aString forKey:(NSString *)aKey
 {
     AWSCognitoRecordValue *data = [[AWSCognitoRecordValue alloc] initWithString:aString];
-    AWSCognitoRecord *record = [self recordForKey:aKey];
+    AWSCognitoRecord *existingRecord = [self recordForKey:aKey];
+    AWSCognitoRecord *record = existingRecord;
     if (record == nil) {
         record = [[AWSCognitoRecord alloc] initWithId:aKey data:data];
     }
@@ -124,10 +141,8 @@
         return;
     }
     
-    int numRecords = [[self.sqliteManager numRecords:self.name] intValue];
-    
     //if you have the max # of records and you aren't replacing an existing one
-    if(numRecords == AWSCognitoMaxNumRecords && !([self recordForKey:aKey] == nil)){
+    if(existingRecord == nil && [[self.sqliteManager numRecords:self.name] unsignedIntValue] >= AWSCognitoMaxNumRecords){
         AWSLogDebug(@"Error: Too many records, max is %d", AWSCognitoMaxNumRecords);
         return;
     }
@@ -150,7 +165,93 @@
         return NO;
     }
     
-    return [self.sqliteManager putRecord:record datasetName:self.name error:error];
+    if(![self.sqliteManager putRecord:record datasetName:self.name error:error]) {
+        return NO;
+    }
+    [self localRecordsChanged];
+    return YES;
+}
+
+- (void)setStrings:(NSDictionary *)strings
+{
+    // keep the sync counts of records that already exist
+    NSDictionary *existingRecords = [self.sqliteManager getRecordsByIds:[strings allKeys] datasetName:self.name error:nil];
+    
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:[strings count]];
+    for (NSString *aKey in strings) {
+        AWSCognitoRecordValue *data = [[AWSCognitoRecordValue alloc] initWithString:[strings objectForKey:aKey]];
+        AWSCognitoRecord *record = [existingRecords objectForKey:aKey];
+        if (record == nil) {
+            record = [[AWSCognitoRecord alloc] initWithId:aKey data:data];
+        }
+        else {
+            record.data = data;
+        }
+        [records addObject:record];
+    }
+    
+    NSError *error = nil;
+    if(![self putRecords:records existingRecords:existingRecords error:&error])
+    {
+        AWSLogDebug(@"Error: %@", error);
+    }
+}
+
+- (BOOL)putRecords:(NSArray *)records error:(NSError **)error
+{
+    NSDictionary *existingRecords = [self.sqliteManager getRecordsByIds:[records valueForKey:@"recordId"] datasetName:self.name error:error];
+    return [self putRecords:records existingRecords:existingRecords error:error];
+}
+
+- (BOOL)putRecords:(NSArray *)records existingRecords:(NSDictionary *)existingRecords error:(NSError **)error
+{
+    NSUInteger newRecords = 0;
+    for (AWSCognitoRecord *record in records) {
+        if(record == nil || record.data == nil || record.recordId == nil)
+        {
+            if(error != nil)
+            {
+                *error = [AWSCognitoUtil errorIllegalArgument:@""];
+            }
+            return NO;
+        }
+        
+        long keySize = [self sizeForString:record.recordId];
+        if(keySize > AWSCognitoMaxKeySize || keySize < AWSCognitoMinKeySize){
+            if(error != nil)
+            {
+                *error = [AWSCognitoUtil errorIllegalArgument:[NSString stringWithFormat:@"Key size of %@ must be between %d and %d bytes", record.recordId, AWSCognitoMinKeySize, AWSCognitoMaxKeySize]];
+            }
+            return NO;
+        }
+        
+        if([self sizeForRecord:record] > AWSCognitoMaxDatasetSize){
+            if(error != nil)
+            {
+                *error = [AWSCognitoUtil errorUserDataSizeLimitExceeded:[NSString stringWithFormat:@"Record %@ would exceed max dataset size", record.recordId]];
+            }
+            return NO;
+        }
+        
+        if([existingRecords objectForKey:record.recordId] == nil){
+            newRecords++;
+        }
+    }
+    
+    //if the new keys would take the dataset past the max # of records
+    if([[self.sqliteManager numRecords:self.name] unsignedIntegerValue] + newRecords > AWSCognitoMaxNumRecords){
+        if(error != nil)
+        {
+            *error = [AWSCognitoUtil errorUserDataSizeLimitExceeded:[NSString stringWithFormat:@"Too many records, max is %d", AWSCognitoMaxNumRecords]];
+        }
+        return NO;
+    }
+    
+    if(![self.sqliteManager putRecords:records datasetName:self.name error:error]) {
+        return NO;
+    }
+    [self localRecordsChanged];
+    return YES;
 }
 
 - (AWSCognitoRecord *)recordForKey: (NSString *)aKey
@@ -194,9 +295,13 @@
         return NO;
     }
     
-    return [self.sqliteManager flagRecordAsDeletedById:recordId
-                                           datasetName:(NSString *)self.name
-                                                 error:error];
+    if(![self.sqliteManager flagRecordAsDeletedById:recordId
+                                        datasetName:(NSString *)self.name
+                                              error:error]) {
+        return NO;
+    }
+    [self localRecordsChanged];
+    return YES;
 }
 
 - (NSArray *)getAllRecords
@@ -242,20 +347,26 @@
     }
     else {
         self.lastSyncCount = [NSNumber numberWithInt:-1];
+        [self localRecordsChanged];
+    }
+}
+
+/**
+ * Counts local writes so synchronize can tell whether a sync in flight started before them,
+ * and queues the dataset with the scheduler of the client that opened it.
+ */
+- (void)localRecordsChanged {
+    @synchronized(self) {
+        self.localWriteCount++;
     }
+    [self.cognito scheduleSynchronize:self.name];
 }
 
 #pragma mark - Size operations
 
 - (long) size {
-    NSArray * allRecords = [self getAllRecords];
-    long size = 0;
-    if(allRecords != nil){
-        for (AWSCognitoRecord *record in allRecords) {
-            size += [self sizeForRecord:record];
-        }
-    }
-    return size;
+    // kept up to date by the local store on every write
+    return [[self.sqliteManager localDataStorage:self.name] longValue];
 }
 
 - (long) sizeForKey: (NSString *) aKey {
@@ -295,16 +406,52 @@
  * 2. Resolve conflicts
  */
 - (AWSTask *)syncPull:(uint32_t)remainingAttempts {
+    self.lastSyncCount = self.currentSyncCount;
+    
+    // an interrupted pull from the same sync count picks up at the first page it didn't write
+    NSNumber *checkpointSyncCount = nil;
+    NSString *checkpointSessionToken = nil;
+    NSString *checkpointNextToken = nil;
+    NSNumber *checkpointAppliedSyncCount = nil;
+    if ([self.sqliteManager syncCheckpoint:self.name syncCount:&checkpointSyncCount sessionToken:&checkpointSessionToken nextToken:&checkpointNextToken appliedSyncCount:&checkpointAppliedSyncCount]
+        && [checkpointSyncCount isEqualToNumber:self.currentSyncCount]) {
+        AWSLogInfo(@"Resuming pull of dataset %@ at sync count %@", self.name, checkpointAppliedSyncCount);
+        self.syncSessionToken = checkpointSessionToken;
+        self.lastSyncCount = checkpointAppliedSyncCount;
+        
+        return [[self syncPullPage:checkpointNextToken syncCount:self.currentSyncCount remainingAttempts:remainingAttempts] continueWithBlock:^id(AWSTask *task) {
+            // the service turned down the checkpoint, e.g. because its session expired
+            if ([task.error.domain isEqualToString:AWSCognitoSyncErrorDomain] && task.error.code != AWSCognitoSyncErrorTooManyRequests) {
+                AWSLogInfo(@"Unable to resume pull of dataset %@, starting over: %@", self.name, task.error);
+                [self.sqliteManager updateSyncCheckpoint:self.name syncCount:nil sessionToken:nil nextToken:nil appliedSyncCount:nil];
+                self.syncSessionToken = nil;
+                self.lastSyncCount = self.currentSyncCount;
+                return [self syncPullPage:nil syncCount:self.currentSyncCount remainingAttempts:remainingAttempts];
+            }
+            return task;
+        }];
+    }
+    
+    return [self syncPullPage:nil syncCount:self.currentSyncCount remainingAttempts:remainingAttempts];
+}
+
+/**
+ * Pulls a single page of changes and writes it locally before requesting the next one,
+ * so only one page of remote records is held in memory at a time.
+ */
+- (AWSTask *)syncPullPage:(NSString *)nextToken syncCount:(NSNumber *)syncCount remainingAttempts:(uint32_t)remainingAttempts {
     
     //list records that have changed since last sync
     AWSCognitoSyncListRecordsRequest *request = [AWSCognitoSyncListRecordsRequest new];
     request.identityPoolId = ((AWSCognitoCredentialsProvider *)self.cognitoService.configuration.credentialsProvider).identityPoolId;
     request.identityId = ((AWSCognitoCredentialsProvider *)self.cognitoService.configuration.credentialsProvider).identityId;
     request.datasetName = self.name;
-    request.lastSyncCount = self.currentSyncCount;
+    request.lastSyncCount = syncCount;
     request.syncSessionToken = self.syncSessionToken;
-    
-    self.lastSyncCount = self.currentSyncCount;
+    request.nextToken = nextToken;
+    if (self.synchronizePageSize > 0) {
+        request.maxResults = [NSNumber numberWithUnsignedInt:self.synchronizePageSize];
+    }
     
     return [[self.cognitoService listRecords:request] continueWithBlock:^id(AWSTask *task) {
         if (task.isCancelled) {
@@ -317,77 +464,91 @@
         }else {
             NSError *error = nil;
             NSMutableArray *conflicts = [NSMutableArray new];
-            // collect updates to write in a transaction
+            // collect the service records to write in a transaction
             NSMutableArray *nonConflictRecords = [NSMutableArray new];
-            NSMutableArray *existingRecords = [NSMutableArray new];
             // keep track of record names for notificaiton
             NSMutableArray *changedRecordNames = [NSMutableArray new];
             AWSCognitoSyncListRecordsResponse *response = task.result;
             self.syncSessionToken = response.syncSessionToken;
             
-            // check the response if dataset is present. If not and we have
-            // a local sync count, the dataset was deleted.
-            // Also check to see if the dataset was deleted and recreated
-            // sinc our last sync
-            if ((self.lastSyncCount != 0 && ![response.datasetExists boolValue]) ||
-                ([response.datasetDeletedAfterRequestedSyncCount boolValue])) {
-                
-                // if the developer has implemented the handler, call it
-                // and if they return NO, we clear data, otherwise we assume the
-                // dataset should be recreated
-                if (self.datasetDeletedHandler && !self.datasetDeletedHandler(self.name)) {
-                    // delete the record data
-                    [self.sqliteManager deleteDataset:self.name error:nil];
+            // dataset state only needs to be checked once per pull
+            if (nextToken == nil) {
+                // check the response if dataset is present. If not and we have
+                // a local sync count, the dataset was deleted.
+                // Also check to see if the dataset was deleted and recreated
+                // sinc our last sync
+                if ((self.lastSyncCount != 0 && ![response.datasetExists boolValue]) ||
+                    ([response.datasetDeletedAfterRequestedSyncCount boolValue])) {
                     
-                    // if the dataset doesn't exist on the remote, clear the
-                    // metadata and return. The push will be a no-op
-                    if (![response.datasetExists boolValue]) {
-                        [self.sqliteManager deleteMetadata:self.name error:nil];
-                        return nil;
+                    // if the developer has implemented the handler, call it
+                    // and if they return NO, we clear data, otherwise we assume the
+                    // dataset should be recreated
+                    if (self.datasetDeletedHandler && !self.datasetDeletedHandler(self.name)) {
+                        // delete the record data
+                        [self.sqliteManager deleteDataset:self.name error:nil];
+                        
+                        // if the dataset doesn't exist on the remote, clear the
+                        // metadata and return. The push will be a no-op
+                        if (![response.datasetExists boolValue]) {
+                            [self.sqliteManager deleteMetadata:self.name error:nil];
+                            return nil;
+                        }
                     }
+                    [self.sqliteManager resetSyncCount:self.name error:nil];
+                    self.lastSyncCount = 0;
+                    self.currentSyncCount = 0;
+                }
+                
+                // check the response for merged datasets, call the appropriate handler
+                if (response.mergedDatasetNames && response.mergedDatasetNames.count > 0 && self.datasetMergedHandler) {
+                    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                        self.datasetMergedHandler(self.name, response.mergedDatasetNames);
+                    });
                 }
-                [self.sqliteManager resetSyncCount:self.name error:nil];
-                self.lastSyncCount = 0;
-                self.currentSyncCount = 0;
-            }
-            
-            // check the response for merged datasets, call the appropriate handler
-            if (response.mergedDatasetNames && response.mergedDatasetNames.count > 0 && self.datasetMergedHandler) {
-                dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-                    self.datasetMergedHandler(self.name, response.mergedDatasetNames);
-                });
             }
             
             if(response.records){
                 // get the dataset sync count for updating the last sync count
                 self.lastSyncCount = response.datasetSyncCount;
+                
+                // look up the local state of every key in the page at once
+                NSDictionary *existingRecords = [self.sqliteManager getRecordsByIds:[response.records valueForKey:@"key"] datasetName:self.name error:&error];
+                
                 for(AWSCognitoSyncRecord *record in response.records){
-                    [existingRecords addObject:record.key];
-                    [changedRecordNames addObject:record.key];
-                    
-                    //overlay local with remote if local isn't dirty
-                    AWSCognitoRecord * existing = [self.sqliteManager getRecordById:record.key datasetName:self.name error:&error];
-                    
-                    AWSCognitoRecordValueType recordType = AWSCognitoRecordValueTypeString;
-                    if (record.value == nil) {
-                        recordType = AWSCognitoRecordValueTypeDeleted;
-                    }
-                    AWSCognitoRecord * newRecord = [[AWSCognitoRecord alloc] initWithId:record.key data:[[AWSCognitoRecordValue alloc]initWithString:record.value type:recordType]];
-                    newRecord.syncCount = [record.syncCount longLongValue];
-                    newRecord.lastModifiedBy = record.lastModifiedBy;
-                    newRecord.lastModified = record.lastModifiedDate;
-                    if(newRecord.lastModifiedBy == nil){
-                        newRecord.lastModifiedBy = @"Unknown";
-                    }
-                    
-                    // separate conflicts from non-conflicts
-                    if(!existing || existing.isDirty==NO || [existing.data.string isEqualToString:record.value]){
-                        [nonConflictRecords addObject: [[AWSCognitoRecordTuple alloc] initWithLocalRecord:existing remoteRecord:newRecord]];
-                    }
-                    else{
-                        //conflict resolution
-                        AWSLogInfo(@"Record %@ is dirty with value: %@ and can't be overwritten, flagging for conflict resolution",existing.recordId,existing.data.string);
-                        [conflicts addObject: [[AWSCognitoConflict alloc] initWithLocalRecord:existing remoteRecord:newRecord]];
+                    @autoreleasepool {
+                        //overlay local with remote if local isn't dirty
+                        AWSCognitoRecord * existing = [existingRecords objectForKey:record.key];
+                        
+                        // nothing to write if the local row already has this sync count and value,
+                        // as it does for the echo of our own push
+                        if(existing && !existing.isDirty && existing.syncCount == [record.syncCount longLongValue]
+                           && (record.value == nil ? [existing isDeleted] : (![existing isDeleted] && [existing.data.string isEqualToString:record.value]))){
+                            self.lastSynchronizeRecordsSkipped++;
+                            continue;
+                        }
+                        [changedRecordNames addObject:record.key];
+                        
+                        // separate conflicts from non-conflicts, which are written as they came
+                        if(!existing || existing.isDirty==NO || [existing.data.string isEqualToString:record.value]){
+                            [nonConflictRecords addObject:record];
+                        }
+                        else{
+                            AWSCognitoRecordValueType recordType = AWSCognitoRecordValueTypeString;
+                            if (record.value == nil) {
+                                recordType = AWSCognitoRecordValueTypeDeleted;
+                            }
+                            AWSCognitoRecord * newRecord = [[AWSCognitoRecord alloc] initWithId:record.key data:[[AWSCognitoRecordValue alloc]initWithString:record.value type:recordType]];
+                            newRecord.syncCount = [record.syncCount longLongValue];
+                            newRecord.lastModifiedBy = record.lastModifiedBy;
+                            newRecord.lastModified = record.lastModifiedDate;
+                            if(newRecord.lastModifiedBy == nil){
+                                newRecord.lastModifiedBy = @"Unknown";
+                            }
+                            
+                            //conflict resolution
+                            AWSLogInfo(@"Record %@ is dirty with value: %@ and can't be overwritten, flagging for conflict resolution",existing.recordId,existing.data.string);
+                            [conflicts addObject: [[AWSCognitoConflict alloc] initWithLocalRecord:existing remoteRecord:newRecord]];
+                        }
                     }
                 }
                 
@@ -414,7 +575,8 @@
                 
                 if (nonConflictRecords.count > 0 || resolvedConflicts.count > 0) {
                     // attempt to write all remote changes
-                    if([self.sqliteManager updateWithRemoteChanges:self.name nonConflicts:nonConflictRecords resolvedConflicts:resolvedConflicts error:&error]) {
+                    if([self.sqliteManager updateWithRemoteRecords:self.name records:nonConflictRecords localRecords:existingRecords resolvedConflicts:resolvedConflicts error:&error]) {
+                        self.lastSynchronizeRecordsWritten += nonConflictRecords.count + resolvedConflicts.count;
                         // successfully wrote data, notify interested parties
                         [self postDidChangeLocalValueFromRemoteNotification:changedRecordNames];
                     }
@@ -423,12 +585,24 @@
                         return [AWSTask taskWithError:error];
                     }
                 }
-                
-                // update our local sync count
-                if(self.currentSyncCount < self.lastSyncCount){
-                    [self.sqliteManager updateLastSyncCount:self.name syncCount:self.lastSyncCount lastModifiedBy:response.lastModifiedBy];
-                }
-                
+            }
+            
+            // keep pulling until the service has no more pages; the local sync count
+            // is only advanced once every page has been written
+            if (response.nextToken.length > 0) {
+                // a pull interrupted from here on resumes with the next page
+                [self.sqliteManager updateSyncCheckpoint:self.name syncCount:syncCount sessionToken:self.syncSessionToken nextToken:response.nextToken appliedSyncCount:self.lastSyncCount];
+                return [self syncPullPage:response.nextToken syncCount:syncCount remainingAttempts:remainingAttempts];
+            }
+            
+            // only multi-page pulls leave a checkpoint behind
+            if (nextToken != nil) {
+                [self.sqliteManager updateSyncCheckpoint:self.name syncCount:nil sessionToken:nil nextToken:nil appliedSyncCount:nil];
+            }
+            
+            // update our local sync count
+            if(self.currentSyncCount < self.lastSyncCount){
+                [self.sqliteManager updateLastSyncCount:self.name syncCount:self.lastSyncCount lastModifiedBy:response.lastModifiedBy];
             }
         }
         
@@ -437,7 +611,6 @@
     
 }
 
-
 /**
  * The push part of the sync
  * 1. Write any changes to remote
@@ -446,133 +619,234 @@
 - (AWSTask *)syncPush:(uint32_t)remainingAttempts {
     
     //if there are no pending conflicts
-    NSMutableArray *patches = [NSMutableArray new];
     NSError *error = nil;
     self.records = [self.sqliteManager recordsUpdatedAfterLastSync:self.name error:&error];
-    NSNumber* maxPatchSyncCount = [NSNumber numberWithLongLong:0L];
     
-    //collect local changes
-    for(AWSCognitoRecord *record in self.records.allValues){
-        AWSCognitoSyncRecordPatch *patch = [AWSCognitoSyncRecordPatch new];
-        patch.key = record.recordId;
-        patch.syncCount = [NSNumber numberWithLongLong: record.syncCount];
-        patch.value = record.data.string;
-        patch.op = [record isDeleted]?AWSCognitoSyncOperationRemove : AWSCognitoSyncOperationReplace;
-        [patches addObject:patch];
-        
+    // if there were local changes
+    if([self.records count] == 0){
+        return nil;
+    }
+    
+    // don't push local changes if they are guaranteed to fail due to dataset size
+    if([self size] > AWSCognitoMaxDatasetSize){
+        NSError *error = [NSError errorWithDomain:AWSCognitoErrorDomain code:AWSCognitoErrorUserDataSizeLimitExceeded userInfo:nil];
+        [self postDidFailToSynchronizeNotification:error];
+        return [AWSTask taskWithError:error];
+    }
+    
+    //collect local changes, in key order so the batches are the same on every attempt
+    NSArray *records = [self.records.allValues sortedArrayUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"recordId" ascending:YES]]];
+    NSUInteger batchSize = self.synchronizePushBatchSize > 0 ? self.synchronizePushBatchSize : [records count];
+    NSMutableArray *batches = [NSMutableArray new];
+    for (NSUInteger offset = 0; offset < [records count]; offset += batchSize) {
+        NSMutableArray *patches = [NSMutableArray arrayWithCapacity:batchSize];
+        for (AWSCognitoRecord *record in [records subarrayWithRange:NSMakeRange(offset, MIN(batchSize, [records count] - offset))]) {
+            AWSCognitoSyncRecordPatch *patch = [AWSCognitoSyncRecordPatch new];
+            patch.key = record.recordId;
+            patch.syncCount = [NSNumber numberWithLongLong: record.syncCount];
+            patch.value = record.data.string;
+            patch.op = [record isDeleted]?AWSCognitoSyncOperationRemove : AWSCognitoSyncOperationReplace;
+            [patches addObject:patch];
+        }
+        [batches addObject:patches];
+    }
+    
+    return [self syncPushBatches:batches index:0 remainingAttempts:remainingAttempts];
+}
+
+/**
+ * Pushes one batch of patches and commits the returned record metadata before pushing the next,
+ * so a conflict only sends the batches that weren't accepted yet again after the re-pull.
+ */
+- (AWSTask *)syncPushBatches:(NSArray *)batches index:(NSUInteger)index remainingAttempts:(uint32_t)remainingAttempts {
+    if(index >= [batches count]){
+        return nil;
+    }
+    
+    NSArray *patches = [batches objectAtIndex:index];
+    NSNumber* maxPatchSyncCount = [NSNumber numberWithLongLong:0L];
+    for(AWSCognitoSyncRecordPatch *patch in patches){
         //track the max sync count
         if([patch.syncCount longLongValue] > [maxPatchSyncCount longLongValue]){
             maxPatchSyncCount = patch.syncCount;
         }
     }
     
-    // if there were local changes
-    if([patches count] > 0){
-        // don't push local changes if they are guaranteed to fail due to dataset size
-        if([self size] > AWSCognitoMaxDatasetSize){
-            NSError *error = [NSError errorWithDomain:AWSCognitoErrorDomain code:AWSCognitoErrorUserDataSizeLimitExceeded userInfo:nil];
+    AWSCognitoSyncUpdateRecordsRequest *request = [AWSCognitoSyncUpdateRecordsRequest new];
+    request.identityId = ((AWSCognitoCredentialsProvider *)self.cognitoService.configuration.credentialsProvider).identityId;
+    request.identityPoolId = ((AWSCognitoCredentialsProvider *)self.cognitoService.configuration.credentialsProvider).identityPoolId;
+    request.datasetName = self.name;
+    request.recordPatches = patches;
+    request.syncSessionToken = self.syncSessionToken;
+    request.deviceId = [AWSCognito cognitoDeviceId];
+    return [[self.cognitoService updateRecords:request] continueWithBlock:^id(AWSTask *task) {
+        NSNumber * currentSyncCount = self.lastSyncCount;
+        BOOL okToUpdateSyncCount = YES;
+        if(task.isCancelled){
+            NSError *error = [NSError errorWithDomain:AWSCognitoErrorDomain code:AWSCognitoErrorTaskCanceled userInfo:nil];
             [self postDidFailToSynchronizeNotification:error];
             return [AWSTask taskWithError:error];
-        }
-
-        AWSCognitoSyncUpdateRecordsRequest *request = [AWSCognitoSyncUpdateRecordsRequest new];
-        request.identityId = ((AWSCognitoCredentialsProvider *)self.cognitoService.configuration.credentialsProvider).identityId;
-        request.identityPoolId = ((AWSCognitoCredentialsProvider *)self.cognitoService.configuration.credentialsProvider).identityPoolId;
-        request.datasetName = self.name;
-        request.recordPatches = patches;
-        request.syncSessionToken = self.syncSessionToken;
-        request.deviceId = [AWSCognito cognitoDeviceId];
-        return [[self.cognitoService updateRecords:request] continueWithBlock:^id(AWSTask *task) {
-            NSNumber * currentSyncCount = self.lastSyncCount;
-            BOOL okToUpdateSyncCount = YES;
-            if(task.isCancelled){
-                NSError *error = [NSError errorWithDomain:AWSCognitoErrorDomain code:AWSCognitoErrorTaskCanceled userInfo:nil];
-                [self postDidFailToSynchronizeNotification:error];
-                return [AWSTask taskWithError:error];
-            }else if(task.error){
-                if(task.error.code == AWSCognitoSyncErrorResourceConflict){
-                    AWSLogInfo("Conflicts existed on update, restarting synchronize.");
-                    if(currentSyncCount > maxPatchSyncCount) {
-                        //it's possible there is a local dirty record with a stale sync count
-                        //this will fix it
-                        [self.sqliteManager updateLastSyncCount:self.name syncCount:maxPatchSyncCount lastModifiedBy:nil];
-                    }
-                    return [self synchronizeInternal:remainingAttempts-1];
-                }
-                else {
-                    AWSLogError(@"An error occured attempting to update records: %@",task.error);
+        }else if(task.error){
+            if(task.error.code == AWSCognitoSyncErrorResourceConflict){
+                AWSLogInfo("Conflicts existed on update, restarting synchronize.");
+                if(currentSyncCount > maxPatchSyncCount) {
+                    //it's possible there is a local dirty record with a stale sync count
+                    //this will fix it
+                    [self.sqliteManager updateLastSyncCount:self.name syncCount:maxPatchSyncCount lastModifiedBy:nil];
                 }
-                return task;
-            }else{
-                AWSCognitoSyncUpdateRecordsResponse * response = task.result;
-                if(response.records) {
-                    NSMutableArray *changedRecords = [NSMutableArray new];
-                    NSMutableArray *changedRecordsNames = [NSMutableArray new];
-                    for (AWSCognitoSyncRecord * record in response.records) {
-                        [changedRecordsNames addObject:record.key];
-                        AWSCognitoRecordValueType recordType = AWSCognitoRecordValueTypeString;
-                        if (record.value == nil) {
-                            recordType = AWSCognitoRecordValueTypeDeleted;
-                        }
-                        AWSCognitoRecord * newRecord = [[AWSCognitoRecord alloc] initWithId:record.key data:[[AWSCognitoRecordValue alloc]initWithString:record.value type:recordType]];
-                        
-                        // Check to see if the sync count on the result is only one more than our current sync
-                        // count. This means that we were the only update and we can safely fastforward
-                        // If not, we'll keep sync count the same so we pull down updates that occurred between
-                        // push and pull.
-                        if(record.syncCount.longLongValue > currentSyncCount.longLongValue + 1){
-                            okToUpdateSyncCount = NO;
-                        }
-                        newRecord.syncCount = [record.syncCount longLongValue];
-                        newRecord.dirtyCount = 0;
-                        newRecord.lastModifiedBy = record.lastModifiedBy;
-                        if(newRecord.lastModifiedBy == nil){
-                            newRecord.lastModifiedBy = @"Unknown";
-                        }
-                        newRecord.lastModified = record.lastModifiedDate;
-                        
-                        AWSCognitoRecord * existingRecord = [self.records objectForKey:record.key];
-                        if(existingRecord == nil){
-                            //this means we got an update returned by the server that we didn't cause
-                            //i.e. based on some updates, the lambda function run server side inserted
-                            //a brand new key unrelated to our patches into our dataset.
-                            //get the current value of that key from our dataset if it exists
-                            //and overwrite it with what was returned from the server
-                            NSError *error = nil;
-                            existingRecord = [self.sqliteManager getRecordById:record.key datasetName:self.name error:&error];
-                        }
-                        
-                        [changedRecords addObject:[[AWSCognitoRecordTuple alloc] initWithLocalRecord:existingRecord remoteRecord:newRecord]];
+                return [self retrySynchronize:remainingAttempts-1];
+            }
+            else {
+                AWSLogError(@"An error occured attempting to update records: %@",task.error);
+            }
+            return task;
+        }else{
+            AWSCognitoSyncUpdateRecordsResponse * response = task.result;
+            if(response.records) {
+                NSMutableArray *changedRecords = [NSMutableArray new];
+                NSMutableArray *changedRecordsNames = [NSMutableArray new];
+                for (AWSCognitoSyncRecord * record in response.records) {
+                    [changedRecordsNames addObject:record.key];
+                    AWSCognitoRecordValueType recordType = AWSCognitoRecordValueTypeString;
+                    if (record.value == nil) {
+                        recordType = AWSCognitoRecordValueTypeDeleted;
                     }
-                    NSError *error = nil;
-                    if([self.sqliteManager updateLocalRecordMetadata:self.name records:changedRecords error:&error]) {
-                        // successfully wrote the update notify interested parties
-                        [self postDidChangeRemoteValueNotification:changedRecordsNames];
-                        if(okToUpdateSyncCount){
-                            //if we only increased the sync count by 1, fast forward the last sync count to our update sync count
-                            [self.sqliteManager updateLastSyncCount:self.name syncCount:[NSNumber numberWithLongLong:currentSyncCount.longLongValue+1] lastModifiedBy:nil];
-                        }
-                    } else {
-                        [self postDidFailToSynchronizeNotification:error];
-                        return [AWSTask taskWithError:error];
+                    AWSCognitoRecord * newRecord = [[AWSCognitoRecord alloc] initWithId:record.key data:[[AWSCognitoRecordValue alloc]initWithString:record.value type:recordType]];
+                    
+                    // Check to see if the sync count on the result is only one more than our current sync
+                    // count. This means that we were the only update and we can safely fastforward
+                    // If not, we'll keep sync count the same so we pull down updates that occurred between
+                    // push and pull.
+                    if(record.syncCount.longLongValue > currentSyncCount.longLongValue + 1){
+                        okToUpdateSyncCount = NO;
                     }
+                    newRecord.syncCount = [record.syncCount longLongValue];
+                    newRecord.dirtyCount = 0;
+                    newRecord.lastModifiedBy = record.lastModifiedBy;
+                    if(newRecord.lastModifiedBy == nil){
+                        newRecord.lastModifiedBy = @"Unknown";
+                    }
+                    newRecord.lastModified = record.lastModifiedDate;
+                    
+                    AWSCognitoRecord * existingRecord = [self.records objectForKey:record.key];
+                    if(existingRecord == nil){
+                        //this means we got an update returned by the server that we didn't cause
+                        //i.e. based on some updates, the lambda function run server side inserted
+                        //a brand new key unrelated to our patches into our dataset.
+                        //get the current value of that key from our dataset if it exists
+                        //and overwrite it with what was returned from the server
+                        NSError *error = nil;
+                        existingRecord = [self.sqliteManager getRecordById:record.key datasetName:self.name error:&error];
+                    }
+                    
+                    [changedRecords addObject:[[AWSCognitoRecordTuple alloc] initWithLocalRecord:existingRecord remoteRecord:newRecord]];
+                }
+                NSError *error = nil;
+                if([self.sqliteManager updateLocalRecordMetadata:self.name records:changedRecords error:&error]) {
+                    // successfully wrote the update notify interested parties
+                    [self postDidChangeRemoteValueNotification:changedRecordsNames];
+                    if(okToUpdateSyncCount){
+                        //if we only increased the sync count by 1, fast forward the last sync count to our update sync count
+                        self.lastSyncCount = [NSNumber numberWithLongLong:currentSyncCount.longLongValue+1];
+                        [self.sqliteManager updateLastSyncCount:self.name syncCount:self.lastSyncCount lastModifiedBy:nil];
+                    }
+                } else {
+                    [self postDidFailToSynchronizeNotification:error];
+                    return [AWSTask taskWithError:error];
                 }
             }
-            return nil;
-        }];
-    }
-    return nil;
+        }
+        return [self syncPushBatches:batches index:index + 1 remainingAttempts:remainingAttempts];
+    }];
 }
 
 - (AWSTask *)synchronize {
-    // uninstall notifier
-    if(self.reachability.reachableBlock != nil){
-        self.reachability.reachableBlock = nil;
-        [self.reachability stopNotifier];
+    return [self synchronizeWithIdentity:nil];
+}
+
+- (AWSTask *)synchronizeWithIdentity:(AWSTask *)identityTask {
+    AWSTaskCompletionSource *source = [AWSTaskCompletionSource taskCompletionSource];
+    @synchronized(self) {
+        // callers arriving while a sync is queued all wait for that one
+        if (self.scheduledSyncSource != nil) {
+            return self.scheduledSyncSource.task;
+        }
+        if (self.inFlightSyncTask != nil) {
+            // the sync in flight already pushes every local write made before it started
+            if (self.localWriteCount == self.syncedLocalWriteCount) {
+                return self.inFlightSyncTask;
+            }
+            return [self scheduleSynchronizeAfter:self.inFlightSyncTask];
+        }
+        if (self.synchronizeDebounceInterval > 0) {
+            return [self scheduleSynchronizeAfter:[AWSTask taskWithDelay:(int)(self.synchronizeDebounceInterval * 1000)]];
+        }
+        [self beginSynchronize:source];
+    }
+    [self runSynchronize:source identity:identityTask];
+    return source.task;
+}
+
+/**
+ * Queues a single sync to start once the given task has finished. Must be called while
+ * synchronized on self.
+ */
+- (AWSTask *)scheduleSynchronizeAfter:(AWSTask *)task {
+    AWSTaskCompletionSource *source = [AWSTaskCompletionSource taskCompletionSource];
+    self.scheduledSyncSource = source;
+    [task continueWithBlock:^id(AWSTask *previousTask) {
+        @synchronized(self) {
+            self.scheduledSyncSource = nil;
+            [self beginSynchronize:source];
+        }
+        [self runSynchronize:source identity:nil];
+        return nil;
+    }];
+    return source.task;
+}
+
+/**
+ * Marks the sync that will complete the given source as in flight. Must be called while
+ * synchronized on self.
+ */
+- (void)beginSynchronize:(AWSTaskCompletionSource *)source {
+    self.inFlightSyncTask = source.task;
+    self.syncedLocalWriteCount = self.localWriteCount;
+}
+
+/**
+ * Runs a sync marked with beginSynchronize: and completes its source once it has finished,
+ * resolving the identity first when no identity task is given.
+ */
+- (void)runSynchronize:(AWSTaskCompletionSource *)source identity:(AWSTask *)identityTask {
+    if (identityTask == nil) {
+        AWSCognitoCredentialsProvider *cognitoCredentials = self.cognitoService.configuration.credentialsProvider;
+        identityTask = [cognitoCredentials getIdentityId];
+    }
+    [[self synchronizeAfterIdentity:identityTask] continueWithBlock:^id(AWSTask *task) {
+        // no longer in flight by the time anything waiting on the source runs
+        @synchronized(self) {
+            self.inFlightSyncTask = nil;
+        }
+        if (task.isCancelled) {
+            [source cancel];
+        } else if (task.error) {
+            [source setError:task.error];
+        } else {
+            [source setResult:task.result];
+        }
+        return nil;
+    }];
+}
+
+- (AWSTask *)synchronizeAfterIdentity:(AWSTask *)identityTask {
+    // a sync waiting for connectivity is no longer needed
+    @synchronized(self) {
+        self.waitingForConnectivity = NO;
     }
     
     // ensure necessary network is available
-    if(self.synchronizeOnWiFiOnly && self.reachability.currentReachabilityStatus != AWSNetworkStatusReachableViaWiFi){
+    if(self.synchronizeOnWiFiOnly && ![self isReachable]){
         NSError *error = [NSError errorWithDomain:AWSCognitoErrorDomain code:AWSCognitoErrorWiFiNotAvailable userInfo:nil];
         [self postDidFailToSynchronizeNotification:error];
         return [AWSTask taskWithError:error];
@@ -584,20 +858,54 @@
     
     self.syncSessionToken = nil;
     
-    AWSCognitoCredentialsProvider *cognitoCredentials = self.cognitoService.configuration.credentialsProvider;
-    return [[[cognitoCredentials getIdentityId] continueWithBlock:^id(AWSTask *task) {
+    return [[identityTask continueWithBlock:^id(AWSTask *task) {
         if (task.error) {
             NSError *error = [NSError errorWithDomain:AWSCognitoErrorDomain code:AWSCognitoAuthenticationFailed userInfo:nil];
             [self postDidFailToSynchronizeNotification:error];
             return [AWSTask taskWithError:error];
         }
+        self.lastSynchronizeAttempts = 0;
+        self.lastSynchronizeRecordsWritten = 0;
+        self.lastSynchronizeRecordsSkipped = 0;
         return [self synchronizeInternal:self.synchronizeRetries];
     }] continueWithBlock:^id(AWSTask *task) {
+        if(!task.isCancelled && !task.error){
+            [AWSCognito refundSynchronizeRetry];
+            if(self.lastSynchronizeAttempts > 1){
+                AWSLogInfo(@"Dataset %@ synchronized after %u attempts", self.name, self.lastSynchronizeAttempts);
+            }
+        }
         [self postDidEndSynchronizeNotification];
         return task;
     }];
 }
 
+/**
+ * Restarts a sync that hit a conflict after a full jitter backoff, unless the process-wide
+ * retry budget has run out.
+ */
+- (AWSTask *)retrySynchronize:(uint32_t)remainingAttempts {
+    if(remainingAttempts == 0){
+        return [self synchronizeInternal:remainingAttempts];
+    }
+    if(![AWSCognito spendSynchronizeRetry]){
+        AWSLogError(@"Conflict retry budget exhausted");
+        NSError *error = [NSError errorWithDomain:AWSCognitoErrorDomain code:AWSCognitoErrorConflictRetriesExhausted userInfo:nil];
+        [self postDidFailToSynchronizeNotification:error];
+        return [AWSTask taskWithError:error];
+    }
+    
+    NSTimeInterval ceiling = MIN(self.synchronizeRetryMaxDelay, self.synchronizeRetryBaseDelay * pow(2, MIN(self.lastSynchronizeAttempts - 1, 30)));
+    int delay = (int)(ceiling * 1000 * ((double)arc4random_uniform(UINT32_MAX) / UINT32_MAX));
+    if(delay <= 0){
+        return [self synchronizeInternal:remainingAttempts];
+    }
+    AWSLogDebug(@"Retrying synchronize of %@ in %dms", self.name, delay);
+    return [[AWSTask taskWithDelay:delay] continueWithBlock:^id(AWSTask *task) {
+        return [self synchronizeInternal:remainingAttempts];
+    }];
+}
+
 - (AWSTask *)synchronizeInternal:(uint32_t)remainingAttempts {
     if(remainingAttempts == 0){
         AWSLogError(@"Conflict retries exhausted");
@@ -605,6 +913,7 @@
         [self postDidFailToSynchronizeNotification:error];
         return [AWSTask taskWithError:error];
     }
+    self.lastSynchronizeAttempts++;
     
     //used for determining if we can fast forward the last sync count after update
     self.currentSyncCount = [self.sqliteManager lastSyncCount:self.name];
@@ -630,27 +939,53 @@
         }];
     }
     
+    // as of the last refreshDatasetMetadata, the remote dataset hasn't changed since it was pulled
+    BOOL pulled = NO;
+    NSNumber *remoteLastModified = [self.sqliteManager remoteLastModified:self.name pulled:&pulled];
+    if(self.synchronizeSkipsUnchangedPull && pulled && [self.currentSyncCount longLongValue] > 0
+       && [[self.sqliteManager recordsUpdatedAfterLastSync:self.name error:nil] count] == 0){
+        AWSLogDebug(@"Dataset %@ is unchanged locally and remotely, skipping synchronize", self.name);
+        return [AWSTask taskWithResult:nil];
+    }
+    
     return [[self syncPull:remainingAttempts] continueWithSuccessBlock:^id(AWSTask *task) {
+        if([remoteLastModified longLongValue] != 0){
+            [self.sqliteManager updatePulledLastModified:self.name lastModified:remoteLastModified];
+        }
         return [self syncPush:remainingAttempts];
     }];
 }
 
+/**
+ * Whether the network needed to synchronize is available, as seen by the client that opened
+ * this dataset.
+ */
+- (BOOL)isReachable {
+    return self.cognito == nil || [self.cognito isReachable:self.synchronizeOnWiFiOnly];
+}
+
 - (AWSTask *)synchronizeOnConnectivity {
     //if no network, or network doesn't match requested network type queue request
-    if(self.reachability.currentReachabilityStatus == AWSNetworkStatusNotReachable
-       || (self.reachability.currentReachabilityStatus != AWSNetworkStatusReachableViaWiFi && self.synchronizeOnWiFiOnly)){
-
-        //set notify on wifi only
-        self.reachability.reachableOnWWAN = !self.synchronizeOnWiFiOnly;
-        
-        //only configure reachable block once
-        if(self.reachability.reachableBlock == nil){
-            __weak AWSCognitoDataset* weakSelf = self;
-            self.reachability.reachableBlock = ^(AWSReachability * reachability){
-                [weakSelf synchronize];
-            };
-            [self.reachability startNotifier];
+    if(![self isReachable]){
+        //only wait once
+        @synchronized(self) {
+            if(self.waitingForConnectivity){
+                return [AWSTask taskWithResult:nil];
+            }
+            self.waitingForConnectivity = YES;
         }
+        __weak AWSCognitoDataset* weakSelf = self;
+        [self.cognito whenReachable:self.synchronizeOnWiFiOnly perform:^{
+            AWSCognitoDataset *strongSelf = weakSelf;
+            BOOL waiting = NO;
+            @synchronized(strongSelf) {
+                waiting = strongSelf.waitingForConnectivity;
+                strongSelf.waitingForConnectivity = NO;
+            }
+            if(waiting){
+                [strongSelf synchronize];
+            }
+        }];
         return [AWSTask taskWithResult:nil];
     }else{
         return [self synchronize];
@@ -742,7 +1077,9 @@
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
         [[NSNotificationCenter defaultCenter] postNotificationName:AWSCognitoDidEndSynchronizeNotification
                                                             object:self
-                                                          userInfo:@{@"dataset": self.name}];
+                                                          userInfo:@{@"dataset": self.name,
+                                                                     @"recordsWritten": [NSNumber numberWithUnsignedInteger:self.lastSynchronizeRecordsWritten],
+                                                                     @"recordsSkipped": [NSNumber numberWithUnsignedInteger:self.lastSynchronizeRecordsSkipped]}];
     });
 }
 
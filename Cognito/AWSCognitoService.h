@@ -26,7 +26,9 @@ extern NSString *const AWSCognitoDidStartSynchronizeNotification;
 /**
  Posted when the synchronization is finished with or without errors.
  The notification sender is an instance of AWSCognitoClient. The userInfo
- contains the dataset name.
+ contains the dataset name, and NSNumbers under "recordsWritten" and
+ "recordsSkipped" counting the pulled records that were written locally
+ and those skipped because the local record already matched.
  @discussion This notification is posted once per synchronization.
  The notification is posted on the Grand Central Dispatch
  DISPATCH_QUEUE_PRIORITY_DEFAULT queue. The user interface should not be
@@ -140,11 +142,59 @@ typedef NS_ENUM(NSInteger, AWSCognitoErrorType) {
  */
 @property (nonatomic, assign) uint32_t synchronizeRetries;
 
+/**
+ The base, in seconds, of the randomized exponential backoff between retries after a conflict.
+ This value will be set on any AWSCognitoDatasets opened with this client. Defaults to 0.1 if
+ not set; 0 retries right away.
+ */
+@property (nonatomic, assign) NSTimeInterval synchronizeRetryBaseDelay;
+
+/**
+ The longest, in seconds, any retry after a conflict will wait. This value will be set on any
+ AWSCognitoDatasets opened with this client. Defaults to 5 if not set.
+ */
+@property (nonatomic, assign) NSTimeInterval synchronizeRetryMaxDelay;
+
 /**
  Only synchronize if device is on a WiFi network. Defaults to NO if not set.
  */
 @property (nonatomic, assign) BOOL synchronizeOnWiFiOnly;
 
+/**
+ The maximum number of records to request per page when pulling remote changes. This value
+ will be set on any AWSCognitoDatasets opened with this client. Defaults to 0 if not set,
+ which lets the service choose the page size.
+ */
+@property (nonatomic, assign) uint32_t synchronizePageSize;
+
+/**
+ The maximum number of local changes to send per request when pushing. This value will be set on
+ any AWSCognitoDatasets opened with this client. Defaults to 0 if not set, which sends all local
+ changes in one request.
+ */
+@property (nonatomic, assign) uint32_t synchronizePushBatchSize;
+
+/**
+ Skip synchronizing datasets that have no local changes and, as of the last refreshDatasetMetadata,
+ no remote changes since they were last pulled. This value will be set on any AWSCognitoDatasets
+ opened with this client. Defaults to NO if not set.
+ */
+@property (nonatomic, assign) BOOL synchronizeSkipsUnchangedPull;
+
+/**
+ The number of seconds a dataset waits after synchronize is called before starting, so that
+ repeated calls become one synchronize. This value will be set on any AWSCognitoDatasets opened
+ with this client. Defaults to 0 if not set, which starts each synchronize right away.
+ */
+@property (nonatomic, assign) NSTimeInterval synchronizeDebounceInterval;
+
+/**
+ Request bodies of at least this many bytes are sent to Amazon Cognito Sync gzip compressed.
+ Pushes of many changes benefit the most. Defaults to 0 if not set, which sends every request
+ uncompressed. See `requestCompressionThreshold` on AWSCognitoSync.
+ */
+@property (nonatomic, assign) NSUInteger requestCompressionThreshold;
+
 /**
  Returns the singleton service client. If the singleton object does not exist, the SDK instantiates the default service client with `defaultServiceConfiguration` from `[AWSServiceManager defaultServiceManager]`. The reference to this object is maintained by the SDK, and you do not need to retain it manually. Returns `nil` if the credentials provider is not an instance of `AWSCognitoCredentials` provider.
 
@@ -292,7 +342,10 @@ typedef NS_ENUM(NSInteger, AWSCognitoErrorType) {
 - (instancetype)initWithConfiguration:(AWSServiceConfiguration *)configuration __attribute__ ((deprecated("Use '+ registerCognitoWithConfiguration:forKey:' and '+ CognitoForKey:' instead.")));
 
 /**
- Opens an existing dataset or creates a new one.
+ Opens an existing dataset or creates a new one. As long as a dataset returned by this method is
+ still in use, opening the same name again returns that instance, so callers share its settings,
+ in-flight synchronize and caches. Changes to this client's settings apply to datasets opened
+ after no instance remains.
  
  @return handle to AWSCognitoDataset
  */
@@ -312,11 +365,69 @@ typedef NS_ENUM(NSInteger, AWSCognitoErrorType) {
  */
 - (AWSTask *)refreshDatasetMetadata;
 
+/**
+ Synchronizes several datasets, running at most maxConcurrency of them at a time. The identity
+ is resolved once for all of them. Each dataset is opened with this client's settings and posts
+ the same notifications as a call to synchronize on it. Returns a AWSTask. The result of this
+ task will be a NSDictionary mapping each dataset name to the finished AWSTask of its synchronize,
+ whose error is set if that dataset failed to synchronize.
+ 
+ @param datasetNames NSArray of dataset names
+ @param maxConcurrency the number of datasets to synchronize at the same time, at least 1
+ */
+- (AWSTask *)synchronizeDatasets:(NSArray *)datasetNames maxConcurrency:(NSUInteger)maxConcurrency;
+
+/**
+ Synchronizes all datasets you have locally, a few at a time. See synchronizeDatasets:maxConcurrency:
+ for the result of the returned AWSTask.
+ */
+- (AWSTask *)synchronizeAll;
+
+/**
+ Turns on scheduled synchronize. Datasets opened with this client are queued when they are written
+ locally, and the queue is synchronized flushInterval seconds after the first write queued, or as
+ soon as flushThreshold datasets are queued, whichever comes first. At most maxConcurrency datasets
+ synchronize at a time, across all flushes. A flush that finds the device offline, or off WiFi
+ when synchronizeOnWiFiOnly is set, keeps the queue until the network is available. Pass 0 for
+ flushInterval or flushThreshold to only flush on the other.
+ */
+- (void)enableSynchronizeScheduler:(NSTimeInterval)flushInterval flushThreshold:(NSUInteger)flushThreshold maxConcurrency:(NSUInteger)maxConcurrency;
+
+/**
+ Turns off scheduled synchronize. Datasets that are still queued keep their local changes until
+ they are next synchronized.
+ */
+- (void)disableSynchronizeScheduler;
+
+/**
+ Synchronizes the queued datasets now instead of waiting for the flush interval or threshold.
+ Returns a AWSTask. The result of this task will be a NSDictionary as returned by
+ synchronizeDatasets:maxConcurrency: for the datasets this flush synchronized, which is empty
+ if nothing was queued or the flush is waiting for the network.
+ */
+- (AWSTask *)flushScheduledSynchronizes;
+
 /**
  Wipe all cached data.
  */
 - (void)wipe;
 
+/**
+ Opt-in to concurrent local reads. Switches the local database to write-ahead logging and
+ opens the given number of read-only connections, so reads such as stringForKey: and getAll
+ no longer wait behind a synchronize that is writing remote changes. Returns NO if the mode
+ could not be enabled, in which case all local access stays serialized.
+ */
+- (BOOL)enableConcurrentLocalReads:(NSUInteger)readConnections;
+
+/**
+ Opt-in to an in-memory cache of local records. Up to countLimit records per dataset are kept
+ once read, so repeated stringForKey: calls for the same keys don't go back to the database.
+ Local writes keep the cache current and changes from a synchronize invalidate it. Pass 0 to
+ turn the cache off.
+ */
+- (void)enableLocalRecordCache:(NSUInteger)countLimit;
+
 /**
  Get the default, last writer wins conflict handler
  */
@@ -351,6 +462,19 @@ typedef NS_ENUM(NSInteger, AWSCognitoErrorType) {
  */
 + (AWSCognitoSyncPlatform)pushPlatform;
 
+/**
+ Sets the number of retries after a conflict that all datasets in this process may make, and
+ refills it. Each retry spends one and each successful synchronize returns one, up to this
+ number. Once it is spent, a conflict fails the synchronize with
+ AWSCognitoErrorConflictRetriesExhausted instead of retrying. Defaults to 50.
+ */
++ (void)setSynchronizeRetryBudget:(uint32_t)retryBudget;
+
+/**
+ The number of retries after a conflict left in the process-wide budget.
+ */
++ (uint32_t)synchronizeRetriesAvailable;
+
 /**
  Subscribe to a list of datasets.  Make sure you have called synchronize on each of the datasets in the list
  at least once prior to calling this. Returns a AWSTask.  The result of this task will be a NSArray of
@@ -15,6 +15,7 @@
 #import "AWSCognitoConflict_Internal.h"
 #import <AWSCore/AWSUICKeyChainStore.h>
 #import <AWSCore/AWSSynchronizedMutableDictionary.h>
+#import <AWSCore/AWSReachability.h>
 
 #import "FABKitProtocol.h"
 #import "Fabric+FABKits.h"
@@ -35,6 +36,10 @@ static AWSUICKeyChainStore *keychain = nil;
 
 static AWSCognitoSyncPlatform _pushPlatform;
 
+// shared by every dataset, guarded by @synchronized([AWSCognito class])
+static uint32_t _synchronizeRetryBudget;
+static uint32_t _synchronizeRetriesAvailable;
+
 @interface AWSCognito() <FABKit>
 
 @property (nonatomic, strong) AWSCognitoSQLiteManager *sqliteManager;
@@ -42,6 +47,26 @@ static AWSCognitoSyncPlatform _pushPlatform;
 @property (nonatomic, strong) AWSCognitoCredentialsProvider *cognitoCredentialsProvider;
 @property (nonatomic, strong) AWSUICKeyChainStore *keychain;
 
+// dataset name to open AWSCognitoDataset, weakly held, guarded by @synchronized(self.openDatasets)
+@property (nonatomic, strong) NSMapTable *openDatasets;
+// one connectivity monitor for every dataset opened with this client
+@property (nonatomic, strong) AWSReachability *reachability;
+// wifiOnly flag and block pairs, guarded by @synchronized(self.connectivityWaiters)
+@property (nonatomic, strong) NSMutableArray *connectivityWaiters;
+
+// scheduled synchronize, guarded by @synchronized(self)
+@property (nonatomic, assign) BOOL schedulerEnabled;
+@property (nonatomic, assign) NSTimeInterval schedulerFlushInterval;
+@property (nonatomic, assign) NSUInteger schedulerFlushThreshold;
+@property (nonatomic, assign) NSUInteger schedulerMaxConcurrency;
+@property (nonatomic, strong) NSMutableOrderedSet *scheduledDatasetNames;
+@property (nonatomic, assign) BOOL scheduledFlushArmed;
+@property (nonatomic, assign) uint64_t scheduledFlushGeneration;
+@property (nonatomic, strong) AWSTask *scheduledFlushTask;
+@property (nonatomic, assign) BOOL scheduledFlushWaitingForConnectivity;
+// runs the flush interval, tests replace it with a virtual clock
+@property (nonatomic, copy) void (^schedulerDispatchAfter)(NSTimeInterval delay, dispatch_block_t block);
+
 @end
 
 @interface AWSCognitoIdentity()
@@ -73,6 +98,8 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
 + (void)initialize {
     keychain = [AWSUICKeyChainStore keyChainStoreWithService:[NSString stringWithFormat:@"%@.%@", [NSBundle mainBundle].bundleIdentifier, [AWSCognito class]]];
     _pushPlatform = [AWSCognitoUtil pushPlatform];
+    _synchronizeRetryBudget = AWSCognitoSynchronizeRetryBudget;
+    _synchronizeRetriesAvailable = AWSCognitoSynchronizeRetryBudget;
 }
 
 + (instancetype)defaultCognito {
@@ -139,14 +166,27 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
         NSString * serviceDeviceId = [AWSCognito cognitoDeviceId];
         _deviceId = (serviceDeviceId) == nil ? @"LOCAL" : serviceDeviceId;
         _synchronizeRetries = AWSCognitoMaxSyncRetries;
+        _synchronizeRetryBaseDelay = AWSCognitoSynchronizeRetryBaseDelay;
+        _synchronizeRetryMaxDelay = AWSCognitoSynchronizeRetryMaxDelay;
         _synchronizeOnWiFiOnly = AWSCognitoSynchronizeOnWiFiOnly;
+        _synchronizePageSize = AWSCognitoSynchronizePageSize;
+        _synchronizePushBatchSize = AWSCognitoSynchronizePushBatchSize;
+        _synchronizeDebounceInterval = AWSCognitoSynchronizeDebounceInterval;
+        _synchronizeSkipsUnchangedPull = AWSCognitoSynchronizeSkipsUnchangedPull;
         
         _conflictHandler = [AWSCognito defaultConflictHandler];
+        _openDatasets = [NSMapTable strongToWeakObjectsMapTable];
+        _scheduledDatasetNames = [NSMutableOrderedSet new];
+        _schedulerDispatchAfter = ^(NSTimeInterval delay, dispatch_block_t block) {
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), block);
+        };
         _sqliteManager = [[AWSCognitoSQLiteManager alloc] initWithIdentityId:_cognitoCredentialsProvider.identityId deviceId:_deviceId];
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
         _cognitoService = [[AWSCognitoSync alloc] initWithConfiguration:configuration];
 #pragma clang diagnostic pop
+        _reachability = [AWSReachability reachabilityWithHostname:_cognitoService.configuration.endpoint.hostName];
+        _connectivityWaiters = [NSMutableArray new];
         // register to know when the identity on our provider changes
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(identityChanged:) name:AWSCognitoIdentityIdChangedNotification object:_cognitoCredentialsProvider.identityProvider];
         
@@ -158,9 +198,32 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
 
 -(void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
+    if (_reachability.reachableBlock != nil) {
+        _reachability.reachableBlock = nil;
+        [_reachability stopNotifier];
+    }
+}
+
+- (NSUInteger)requestCompressionThreshold {
+    return self.cognitoService.requestCompressionThreshold;
+}
+
+- (void)setRequestCompressionThreshold:(NSUInteger)requestCompressionThreshold {
+    self.cognitoService.requestCompressionThreshold = requestCompressionThreshold;
 }
 
 - (AWSCognitoDataset *)openOrCreateDataset:(NSString * ) datasetName{
+    @synchronized(self.openDatasets) {
+        AWSCognitoDataset *dataset = [self.openDatasets objectForKey:datasetName];
+        if (dataset == nil) {
+            dataset = [self createDataset:datasetName];
+            [self.openDatasets setObject:dataset forKey:datasetName];
+        }
+        return dataset;
+    }
+}
+
+- (AWSCognitoDataset *)createDataset:(NSString *)datasetName {
     AWSCognitoDataset *dataset = [[AWSCognitoDataset alloc] initWithDatasetName:datasetName
                                                                   sqliteManager:self.sqliteManager
                                                                  cognitoService:self.cognitoService];
@@ -168,7 +231,14 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
     dataset.datasetDeletedHandler = self.datasetDeletedHandler;
     dataset.datasetMergedHandler = self.datasetMergedHandler;
     dataset.synchronizeRetries = self.synchronizeRetries;
+    dataset.synchronizeRetryBaseDelay = self.synchronizeRetryBaseDelay;
+    dataset.synchronizeRetryMaxDelay = self.synchronizeRetryMaxDelay;
     dataset.synchronizeOnWiFiOnly = self.synchronizeOnWiFiOnly;
+    dataset.synchronizePageSize = self.synchronizePageSize;
+    dataset.synchronizePushBatchSize = self.synchronizePushBatchSize;
+    dataset.synchronizeDebounceInterval = self.synchronizeDebounceInterval;
+    dataset.synchronizeSkipsUnchangedPull = self.synchronizeSkipsUnchangedPull;
+    dataset.cognito = self;
     
     // register the dataset to receive notifications from this instance when the identity changes
     [[NSNotificationCenter defaultCenter] addObserver:dataset selector:@selector(identityChanged:) name:AWSCognitoIdentityIdChangedInternalNotification object:self];
@@ -177,10 +247,22 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
 }
 
 - (void)wipe {
+    // datasets opened after this start from the wiped tables
+    @synchronized(self.openDatasets) {
+        [self.openDatasets removeAllObjects];
+    }
     [self.sqliteManager deleteAllData];
     [self.cognitoCredentialsProvider clearKeychain];
 }
 
+- (BOOL)enableConcurrentLocalReads:(NSUInteger)readConnections {
+    return [self.sqliteManager enableConcurrentReads:readConnections];
+}
+
+- (void)enableLocalRecordCache:(NSUInteger)countLimit {
+    [self.sqliteManager enableRecordCache:countLimit];
+}
+
 - (AWSTask *)refreshDatasetMetadata {
     return [[[self.cognitoCredentialsProvider getIdentityId] continueWithBlock:^id(AWSTask *task) {
         if (task.error) {
@@ -204,6 +286,203 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
     }];
 }
 
+- (AWSTask *)synchronizeDatasets:(NSArray *)datasetNames maxConcurrency:(NSUInteger)maxConcurrency {
+    NSMutableArray *pendingNames = [[[NSOrderedSet orderedSetWithArray:datasetNames] array] mutableCopy];
+    NSMutableDictionary *results = [NSMutableDictionary dictionaryWithCapacity:[pendingNames count]];
+    NSUInteger workerCount = MAX(1, MIN(maxConcurrency, [pendingNames count]));
+    
+    AWSTask *identityTask = [self.cognitoCredentialsProvider getIdentityId];
+    NSMutableArray *workers = [NSMutableArray arrayWithCapacity:workerCount];
+    for (NSUInteger i = 0; i < workerCount; i++) {
+        [workers addObject:[self synchronizeNextDataset:pendingNames identity:identityTask results:results]];
+    }
+    return [[AWSTask taskForCompletionOfAllTasks:workers] continueWithBlock:^id(AWSTask *task) {
+        @synchronized(results) {
+            return [AWSTask taskWithResult:[results copy]];
+        }
+    }];
+}
+
+/**
+ * Synchronizes the pending datasets one after another until none are left. synchronizeDatasets:
+ * runs several of these side by side.
+ */
+- (AWSTask *)synchronizeNextDataset:(NSMutableArray *)pendingNames identity:(AWSTask *)identityTask results:(NSMutableDictionary *)results {
+    NSString *datasetName = nil;
+    @synchronized(pendingNames) {
+        datasetName = [pendingNames firstObject];
+        if (datasetName != nil) {
+            [pendingNames removeObjectAtIndex:0];
+        }
+    }
+    if (datasetName == nil) {
+        return [AWSTask taskWithResult:nil];
+    }
+    
+    AWSCognitoDataset *dataset = [self openOrCreateDataset:datasetName];
+    return [[dataset synchronizeWithIdentity:identityTask] continueWithBlock:^id(AWSTask *task) {
+        @synchronized(results) {
+            [results setObject:task forKey:datasetName];
+        }
+        return [self synchronizeNextDataset:pendingNames identity:identityTask results:results];
+    }];
+}
+
+- (AWSTask *)synchronizeAll {
+    NSArray * datasets = [self listDatasets];
+    NSMutableArray * datasetNames = [NSMutableArray new];
+    for (AWSCognitoDatasetMetadata * dataset in datasets) {
+        [datasetNames addObject:dataset.name];
+    }
+    return [self synchronizeDatasets:datasetNames maxConcurrency:AWSCognitoSynchronizeMaxConcurrency];
+}
+
+#pragma mark - Connectivity
+
+/**
+ * Whether the network is available, and on WiFi if wifiOnly is set.
+ */
+- (BOOL)isReachable:(BOOL)wifiOnly {
+    if (self.reachability.currentReachabilityStatus == AWSNetworkStatusReachableViaWiFi) {
+        return YES;
+    }
+    return !wifiOnly && self.reachability.currentReachabilityStatus != AWSNetworkStatusNotReachable;
+}
+
+/**
+ * Runs the block once the network is available, and on WiFi if wifiOnly is set. Datasets and the
+ * scheduler all wait through here, so one notifier serves every pending synchronize and only runs
+ * while something is waiting.
+ */
+- (void)whenReachable:(BOOL)wifiOnly perform:(dispatch_block_t)block {
+    @synchronized(self.connectivityWaiters) {
+        [self.connectivityWaiters addObject:@[[NSNumber numberWithBool:wifiOnly], [block copy]]];
+        if ([self.connectivityWaiters count] == 1) {
+            __weak AWSCognito *weakSelf = self;
+            self.reachability.reachableOnWWAN = YES;
+            self.reachability.reachableBlock = ^(AWSReachability *reachability) {
+                [weakSelf reachabilityChanged];
+            };
+            [self.reachability startNotifier];
+        }
+    }
+}
+
+- (void)reachabilityChanged {
+    NSMutableArray *ready = [NSMutableArray new];
+    @synchronized(self.connectivityWaiters) {
+        NSMutableIndexSet *readyIndexes = [NSMutableIndexSet new];
+        [self.connectivityWaiters enumerateObjectsUsingBlock:^(NSArray *waiter, NSUInteger idx, BOOL *stop) {
+            if ([self isReachable:[waiter[0] boolValue]]) {
+                [readyIndexes addIndex:idx];
+                [ready addObject:waiter[1]];
+            }
+        }];
+        [self.connectivityWaiters removeObjectsAtIndexes:readyIndexes];
+        if ([self.connectivityWaiters count] == 0) {
+            self.reachability.reachableBlock = nil;
+            [self.reachability stopNotifier];
+        }
+    }
+    for (dispatch_block_t block in ready) {
+        block();
+    }
+}
+
+#pragma mark - Scheduled synchronize
+
+- (void)enableSynchronizeScheduler:(NSTimeInterval)flushInterval flushThreshold:(NSUInteger)flushThreshold maxConcurrency:(NSUInteger)maxConcurrency {
+    @synchronized(self) {
+        self.schedulerEnabled = YES;
+        self.schedulerFlushInterval = flushInterval;
+        self.schedulerFlushThreshold = flushThreshold;
+        self.schedulerMaxConcurrency = maxConcurrency;
+    }
+}
+
+- (void)disableSynchronizeScheduler {
+    @synchronized(self) {
+        self.schedulerEnabled = NO;
+        [self.scheduledDatasetNames removeAllObjects];
+        self.scheduledFlushArmed = NO;
+        self.scheduledFlushGeneration++;
+        self.scheduledFlushWaitingForConnectivity = NO;
+    }
+}
+
+/**
+ * Called by datasets opened with this client whenever they are written locally.
+ */
+- (void)scheduleSynchronize:(NSString *)datasetName {
+    BOOL flush = NO;
+    @synchronized(self) {
+        if (!self.schedulerEnabled) {
+            return;
+        }
+        [self.scheduledDatasetNames addObject:datasetName];
+        if (self.schedulerFlushThreshold > 0 && [self.scheduledDatasetNames count] >= self.schedulerFlushThreshold) {
+            flush = YES;
+        } else if (self.schedulerFlushInterval > 0 && !self.scheduledFlushArmed) {
+            self.scheduledFlushArmed = YES;
+            uint64_t generation = self.scheduledFlushGeneration;
+            __weak AWSCognito *weakSelf = self;
+            self.schedulerDispatchAfter(self.schedulerFlushInterval, ^{
+                AWSCognito *strongSelf = weakSelf;
+                @synchronized(strongSelf) {
+                    // a flush since this was armed already took the queue
+                    if (strongSelf == nil || strongSelf.scheduledFlushGeneration != generation) {
+                        return;
+                    }
+                }
+                [strongSelf flushScheduledSynchronizes];
+            });
+        }
+    }
+    if (flush) {
+        [self flushScheduledSynchronizes];
+    }
+}
+
+- (AWSTask *)flushScheduledSynchronizes {
+    @synchronized(self) {
+        self.scheduledFlushArmed = NO;
+        self.scheduledFlushGeneration++;
+        if ([self.scheduledDatasetNames count] == 0) {
+            return [AWSTask taskWithResult:@{}];
+        }
+        
+        //if no network, or network doesn't match requested network type keep the queue
+        if (![self isReachable:self.synchronizeOnWiFiOnly]) {
+            if (!self.scheduledFlushWaitingForConnectivity) {
+                self.scheduledFlushWaitingForConnectivity = YES;
+                __weak AWSCognito *weakSelf = self;
+                [self whenReachable:self.synchronizeOnWiFiOnly perform:^{
+                    AWSCognito *strongSelf = weakSelf;
+                    BOOL waiting = NO;
+                    @synchronized(strongSelf) {
+                        waiting = strongSelf.scheduledFlushWaitingForConnectivity;
+                        strongSelf.scheduledFlushWaitingForConnectivity = NO;
+                    }
+                    if (waiting) {
+                        [strongSelf flushScheduledSynchronizes];
+                    }
+                }];
+            }
+            return [AWSTask taskWithResult:@{}];
+        }
+        
+        NSArray *datasetNames = [self.scheduledDatasetNames array];
+        [self.scheduledDatasetNames removeAllObjects];
+        NSUInteger maxConcurrency = self.schedulerMaxConcurrency;
+        // flushes run one after another so together they stay within maxConcurrency
+        AWSTask *previousFlush = self.scheduledFlushTask ?: [AWSTask taskWithResult:nil];
+        self.scheduledFlushTask = [previousFlush continueWithBlock:^id(AWSTask *task) {
+            return [self synchronizeDatasets:datasetNames maxConcurrency:maxConcurrency];
+        }];
+        return self.scheduledFlushTask;
+    }
+}
+
 - (NSArray *)listDatasets {
     return [self.sqliteManager getDatasets:nil];
 }
@@ -299,6 +578,37 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
     return _pushPlatform;
 }
 
++ (void)setSynchronizeRetryBudget:(uint32_t)retryBudget {
+    @synchronized([AWSCognito class]) {
+        _synchronizeRetryBudget = retryBudget;
+        _synchronizeRetriesAvailable = retryBudget;
+    }
+}
+
++ (uint32_t)synchronizeRetriesAvailable {
+    @synchronized([AWSCognito class]) {
+        return _synchronizeRetriesAvailable;
+    }
+}
+
++ (BOOL)spendSynchronizeRetry {
+    @synchronized([AWSCognito class]) {
+        if (_synchronizeRetriesAvailable == 0) {
+            return NO;
+        }
+        _synchronizeRetriesAvailable--;
+        return YES;
+    }
+}
+
++ (void)refundSynchronizeRetry {
+    @synchronized([AWSCognito class]) {
+        if (_synchronizeRetriesAvailable < _synchronizeRetryBudget) {
+            _synchronizeRetriesAvailable++;
+        }
+    }
+}
+
 -(AWSTask *)subscribe:(NSArray *) datasetNames {
     NSMutableArray *tasks = [NSMutableArray new];
     for (NSString * datasetName in datasetNames) {
@@ -16,6 +16,13 @@ FOUNDATION_EXPORT NSString *const AWSCognitoLastModifiedFieldName;
 FOUNDATION_EXPORT NSString *const AWSCognitoModifiedByFieldName;
 FOUNDATION_EXPORT NSString *const AWSCognitoRecordCountFieldName;
 FOUNDATION_EXPORT NSString *const AWSCognitoDataStorageFieldName;
+FOUNDATION_EXPORT NSString *const AWSCognitoLocalRecordCountFieldName;
+FOUNDATION_EXPORT NSString *const AWSCognitoLocalDataStorageFieldName;
+FOUNDATION_EXPORT NSString *const AWSCognitoPulledLastModifiedFieldName;
+FOUNDATION_EXPORT NSString *const AWSCognitoCheckpointSyncCountFieldName;
+FOUNDATION_EXPORT NSString *const AWSCognitoCheckpointSessionTokenFieldName;
+FOUNDATION_EXPORT NSString *const AWSCognitoCheckpointNextTokenFieldName;
+FOUNDATION_EXPORT NSString *const AWSCognitoCheckpointAppliedSyncCountFieldName;
 FOUNDATION_EXPORT NSString *const AWSCognitoDatasetCreationDateFieldName;
 FOUNDATION_EXPORT NSString *const AWSCognitoDirtyFieldName;
 FOUNDATION_EXPORT NSString *const AWSCognitoSyncCountFieldName;
@@ -28,7 +35,15 @@ FOUNDATION_EXPORT int64_t const AWSCognitoNotSyncedDeletedRecordDirty;
 FOUNDATION_EXPORT NSString *const AWSCognitoUserDefaultsUserAgentPrefix;
 
 FOUNDATION_EXPORT uint32_t const AWSCognitoMaxSyncRetries;
+FOUNDATION_EXPORT NSTimeInterval const AWSCognitoSynchronizeRetryBaseDelay;
+FOUNDATION_EXPORT NSTimeInterval const AWSCognitoSynchronizeRetryMaxDelay;
+FOUNDATION_EXPORT uint32_t const AWSCognitoSynchronizeRetryBudget;
 FOUNDATION_EXPORT BOOL const AWSCognitoSynchronizeOnWiFiOnly;
+FOUNDATION_EXPORT BOOL const AWSCognitoSynchronizeSkipsUnchangedPull;
+FOUNDATION_EXPORT uint32_t const AWSCognitoSynchronizePageSize;
+FOUNDATION_EXPORT uint32_t const AWSCognitoSynchronizePushBatchSize;
+FOUNDATION_EXPORT uint32_t const AWSCognitoSynchronizeMaxConcurrency;
+FOUNDATION_EXPORT NSTimeInterval const AWSCognitoSynchronizeDebounceInterval;
 
 FOUNDATION_EXPORT uint32_t const AWSCognitoMaxDatasetSize;
 FOUNDATION_EXPORT uint32_t const AWSCognitoMinKeySize;
@@ -36,6 +51,13 @@ FOUNDATION_EXPORT uint32_t const AWSCognitoMaxKeySize;
 FOUNDATION_EXPORT uint32_t const AWSCognitoMaxRecordValueSize;
 FOUNDATION_EXPORT uint32_t const AWSCognitoMaxNumRecords;
 
+FOUNDATION_EXPORT int32_t const AWSCognitoSQLiteRawValueFormatVersion;
+FOUNDATION_EXPORT int32_t const AWSCognitoSQLiteLocalCountersVersion;
+FOUNDATION_EXPORT int32_t const AWSCognitoSQLiteDirtyRecordIndexVersion;
+FOUNDATION_EXPORT int32_t const AWSCognitoSQLitePullTrackingVersion;
+FOUNDATION_EXPORT int32_t const AWSCognitoSQLiteSyncCheckpointVersion;
+FOUNDATION_EXPORT int32_t const AWSCognitoSQLiteSchemaVersion;
+
 FOUNDATION_EXPORT NSString *const AWSCognitoSyncPushApns;
 FOUNDATION_EXPORT NSString *const AWSCognitoSyncPushApnsSandbox;
 
@@ -16,6 +16,13 @@ NSString *const AWSCognitoLastModifiedFieldName = @"LastModified";
 NSString *const AWSCognitoModifiedByFieldName = @"ModifiedBy";
 NSString *const AWSCognitoRecordCountFieldName = @"RecordCount";
 NSString *const AWSCognitoDataStorageFieldName = @"DataStorage";
+NSString *const AWSCognitoLocalRecordCountFieldName = @"LocalRecordCount";
+NSString *const AWSCognitoLocalDataStorageFieldName = @"LocalDataStorage";
+NSString *const AWSCognitoPulledLastModifiedFieldName = @"PulledLastModified";
+NSString *const AWSCognitoCheckpointSyncCountFieldName = @"CheckpointSyncCount";
+NSString *const AWSCognitoCheckpointSessionTokenFieldName = @"CheckpointSessionToken";
+NSString *const AWSCognitoCheckpointNextTokenFieldName = @"CheckpointNextToken";
+NSString *const AWSCognitoCheckpointAppliedSyncCountFieldName = @"CheckpointAppliedSyncCount";
 NSString *const AWSCognitoDatasetCreationDateFieldName = @"CreationDate";
 NSString *const AWSCognitoDirtyFieldName = @"Dirty";
 NSString *const AWSCognitoDatasetFieldName = @"Dataset";
@@ -30,7 +37,15 @@ NSString *const AWSCognitoSyncPushApns = @"APNS";
 NSString *const AWSCognitoSyncPushApnsSandbox = @"APNS_SANDBOX";
 
 uint32_t const AWSCognitoMaxSyncRetries = 5;
+NSTimeInterval const AWSCognitoSynchronizeRetryBaseDelay = 0.1;
+NSTimeInterval const AWSCognitoSynchronizeRetryMaxDelay = 5;
+uint32_t const AWSCognitoSynchronizeRetryBudget = 50;
 BOOL const AWSCognitoSynchronizeOnWiFiOnly = NO;
+BOOL const AWSCognitoSynchronizeSkipsUnchangedPull = NO;
+uint32_t const AWSCognitoSynchronizePageSize = 0;
+uint32_t const AWSCognitoSynchronizePushBatchSize = 0;
+uint32_t const AWSCognitoSynchronizeMaxConcurrency = 4;
+NSTimeInterval const AWSCognitoSynchronizeDebounceInterval = 0;
 
 uint32_t const AWSCognitoMaxDatasetSize = 1024*1024;
 uint32_t const AWSCognitoMinKeySize = 1;
@@ -38,6 +53,13 @@ uint32_t const AWSCognitoMaxKeySize = 128;
 uint32_t const AWSCognitoMaxRecordValueSize = AWSCognitoMaxDatasetSize-1;
 uint32_t const AWSCognitoMaxNumRecords = 1024;
 
+int32_t const AWSCognitoSQLiteRawValueFormatVersion = 1;
+int32_t const AWSCognitoSQLiteLocalCountersVersion = 2;
+int32_t const AWSCognitoSQLiteDirtyRecordIndexVersion = 3;
+int32_t const AWSCognitoSQLitePullTrackingVersion = 4;
+int32_t const AWSCognitoSQLiteSyncCheckpointVersion = 5;
+int32_t const AWSCognitoSQLiteSchemaVersion = AWSCognitoSQLiteSyncCheckpointVersion;
+
 
 #pragma mark - Standard error messages
 
@@ -4,7 +4,9 @@
 
 #import "AWSCognitoDataset.h"
 
+@class AWSCognito;
 @class AWSCognitoSync;
+@class AWSTask;
 
 @interface AWSCognitoDatasetMetadata()
 
@@ -27,4 +29,17 @@
                       sqliteManager:(AWSCognitoSQLiteManager *)sqliteManager
                      cognitoService:(AWSCognitoSync *)cognitoService;
 
+/**
+ * Synchronizes once the given identity task has finished, so several datasets can share a
+ * single getIdentityId call. synchronize passes nil, which resolves the identity when the
+ * sync starts. Like synchronize, joins a sync that is already in flight or queued.
+ */
+- (AWSTask *)synchronizeWithIdentity:(AWSTask *)identityTask;
+
+/**
+ * The client that opened this dataset. Its scheduler is told about local writes and its
+ * connectivity monitor decides when synchronizeOnConnectivity can go ahead.
+ */
+@property (nonatomic, strong) AWSCognito *cognito;
+
 @end
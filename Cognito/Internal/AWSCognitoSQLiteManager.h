@@ -18,20 +18,57 @@
 - (void)deleteAllData;
 - (void)deleteSQLiteDatabase;
 
+/**
+ * Switches the database to WAL mode and opens a pool of read-only connections so that
+ * record and dataset reads no longer wait behind writes on the serial queue.
+ * Returns NO, leaving all access serialized, if WAL mode could not be enabled.
+ **/
+- (BOOL)enableConcurrentReads:(NSUInteger)readConnections;
+
+/**
+ * Keeps up to countLimit records per dataset in memory once they have been read through
+ * getRecordById:. Local writes update the cached copies; remote changes, sync count updates,
+ * dataset deletion and reparenting drop them. A countLimit of 0 turns the cache off.
+ **/
+- (void)enableRecordCache:(NSUInteger)countLimit;
+@property (nonatomic, readonly) NSUInteger recordCacheHits;
+@property (nonatomic, readonly) NSUInteger recordCacheMisses;
+
 - (NSArray *)getDatasets:(NSError **)error;
 - (void)loadDatasetMetadata:(AWSCognitoDatasetMetadata *)dataset error:(NSError **)error;
 - (BOOL)putDatasetMetadata:(NSArray *)datasets error:(NSError **)error;
 - (AWSCognitoRecord *)getRecordById:(NSString *)recordId datasetName:(NSString *)datasetName error:(NSError **)error;
+/**
+ * Fetches the local records for the given keys in a single query. Keys with no local
+ * record are absent from the returned dictionary, which maps key to AWSCognitoRecord.
+ **/
+- (NSDictionary *)getRecordsByIds:(NSArray *)recordIds datasetName:(NSString *)datasetName error:(NSError **)error;
 - (BOOL)putRecord:(AWSCognitoRecord *)record datasetName:(NSString *)datasetName  error:(NSError **)error;
+- (BOOL)putRecords:(NSArray *)records datasetName:(NSString *)datasetName error:(NSError **)error;
 - (BOOL)flagRecordAsDeletedById:(NSString *)recordId datasetName:(NSString *)datasetName  error:(NSError **)error;
 - (BOOL)deleteRecordById:(NSString *)recordId datasetName:(NSString *)datasetName error:(NSError **)error;
 - (BOOL)deleteDataset:(NSString *)datasetName error:(NSError **)error;
 - (BOOL)deleteMetadata:(NSString *)datasetName error:(NSError **)error;
 - (BOOL)updateWithRemoteChanges:(NSString *)datasetName nonConflicts:(NSArray *)nonConflictRecords resolvedConflicts:(NSArray *)resolvedConflicts error:(NSError **)error;
+/**
+ * Like updateWithRemoteChanges:, but binds the non-conflicting AWSCognitoSyncRecords straight
+ * into the write instead of taking them as AWSCognitoRecordTuples. localRecords maps key to the
+ * local AWSCognitoRecord a write is conditional on; records without one are inserted.
+ **/
+- (BOOL)updateWithRemoteRecords:(NSString *)datasetName records:(NSArray *)remoteRecords localRecords:(NSDictionary *)localRecords resolvedConflicts:(NSArray *)resolvedConflicts error:(NSError **)error;
 - (BOOL)updateLocalRecordMetadata:(NSString *)datasetName records:(NSArray *)updatedRecords error:(NSError **)error;
 - (BOOL)resetSyncCount:(NSString *)datasetName error:(NSError **)error;
 
 - (NSNumber *) numRecords:(NSString *)datasetName;
+- (NSNumber *)localDataStorage:(NSString *)datasetName;
+
+/**
+ * The record count and data size of each dataset are kept in CognitoMetadata by triggers on
+ * CognitoData. Verifying compares them against the stored records and fails if they drifted;
+ * repairing recomputes them for every dataset of the current identity.
+ **/
+- (BOOL)verifyLocalCounters:(NSString *)datasetName error:(NSError **)error;
+- (BOOL)repairLocalCounters:(NSError **)error;
 
 - (NSArray *)getMergeDatasets:(NSString *)datasetName error:(NSError **)error;
 - (BOOL)reparentDatasets:(NSString *)oldId withNewId:(NSString *)newId error:(NSError **)error;
@@ -42,4 +79,23 @@
 - (NSNumber *)lastSyncCount:(NSString *)datasetName;
 - (void)updateLastSyncCount:(NSString *)datasetName syncCount:(NSNumber *)syncCount lastModifiedBy:(NSString *)lastModifiedBy;
 
+/**
+ * Returns the remote last modified date, in milliseconds, stored for the dataset by the last
+ * putDatasetMetadata:, or 0 if it is not known. pulled is set to YES if a pull has completed
+ * since the remote dataset was at that date, as recorded by updatePulledLastModified:.
+ * Datasets missing from a putDatasetMetadata: call are no longer considered pulled.
+ **/
+- (NSNumber *)remoteLastModified:(NSString *)datasetName pulled:(BOOL *)pulled;
+- (void)updatePulledLastModified:(NSString *)datasetName lastModified:(NSNumber *)lastModified;
+
+/**
+ * A paged pull checkpoints each page it writes that has a next page: the sync count the pull
+ * started from, its session token, the token of the next page and the dataset sync count the
+ * pages written so far bring the dataset to. Returns NO if the dataset has no checkpoint.
+ * Updating with a nil nextToken clears the checkpoint. Any change to the last sync count
+ * through updateLastSyncCount: also clears it.
+ **/
+- (BOOL)syncCheckpoint:(NSString *)datasetName syncCount:(NSNumber **)syncCount sessionToken:(NSString **)sessionToken nextToken:(NSString **)nextToken appliedSyncCount:(NSNumber **)appliedSyncCount;
+- (void)updateSyncCheckpoint:(NSString *)datasetName syncCount:(NSNumber *)syncCount sessionToken:(NSString *)sessionToken nextToken:(NSString *)nextToken appliedSyncCount:(NSNumber *)appliedSyncCount;
+
 @end
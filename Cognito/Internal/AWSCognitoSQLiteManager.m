@@ -15,19 +15,269 @@
 #import "AWSCognitoConflict_Internal.h"
 #import "AWSCognitoSyncService.h"
 
+/**
+ * Statements that are prepared once per connection and reused for the lifetime of the manager.
+ **/
+typedef NS_ENUM(NSInteger, AWSCognitoSQLiteStatement) {
+    AWSCognitoSQLiteStatementInitializeDataset = 0,
+    AWSCognitoSQLiteStatementGetDatasets,
+    AWSCognitoSQLiteStatementLoadDatasetMetadata,
+    AWSCognitoSQLiteStatementPutDatasetMetadata,
+    AWSCognitoSQLiteStatementUpdateDatasetMetadata,
+    AWSCognitoSQLiteStatementGetRecord,
+    AWSCognitoSQLiteStatementDirtyRecords,
+    AWSCognitoSQLiteStatementAllRecords,
+    AWSCognitoSQLiteStatementPutRecord,
+    AWSCognitoSQLiteStatementConditionalUpdateRecord,
+    AWSCognitoSQLiteStatementConditionalInsertRecord,
+    AWSCognitoSQLiteStatementFlagRecordAsDeleted,
+    AWSCognitoSQLiteStatementDeleteRecord,
+    AWSCognitoSQLiteStatementNumRecords,
+    AWSCognitoSQLiteStatementLocalDataStorage,
+    AWSCognitoSQLiteStatementLastSyncCount,
+    AWSCognitoSQLiteStatementUpdateLastSyncCount,
+    AWSCognitoSQLiteStatementPullState,
+    AWSCognitoSQLiteStatementUpdatePulledLastModified,
+    AWSCognitoSQLiteStatementSyncCheckpoint,
+    AWSCognitoSQLiteStatementUpdateSyncCheckpoint,
+    AWSCognitoSQLiteStatementDeleteDatasetRecords,
+    AWSCognitoSQLiteStatementCount
+};
+
+/**
+ * A single SQLite connection together with the statements prepared on it.
+ * A connection must only be used by one thread at a time.
+ **/
+@interface AWSCognitoSQLiteConnection : NSObject
+{
+    sqlite3_stmt *_statements[AWSCognitoSQLiteStatementCount];
+}
+
+@property (nonatomic, readonly) sqlite3 *sqlite;
+
+- (instancetype)initWithSQLite:(sqlite3 *)sqlite;
+- (sqlite3_stmt *)statement:(AWSCognitoSQLiteStatement)statementType;
+- (void)prepareStatements;
+- (void)finalizeStatements;
+- (void)close;
+
+@end
+
+/**
+ * Bounded cache of the records read through getRecordById:, holding up to countLimit records
+ * per dataset. A record that doesn't exist is cached as NSNull. Every change bumps the
+ * generation, and a reader only stores what it read if nothing changed since it started,
+ * so a read racing a write on another connection can't leave an old value behind.
+ **/
+@interface AWSCognitoRecordCache : NSObject
+{
+    NSMutableDictionary *_datasets;
+    NSUInteger _hits;
+    NSUInteger _misses;
+    uint64_t _generation;
+}
+
+@property (nonatomic, readonly) NSUInteger countLimit;
+@property (nonatomic, readonly) NSUInteger hits;
+@property (nonatomic, readonly) NSUInteger misses;
+@property (nonatomic, readonly) uint64_t generation;
+
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit;
+- (id)objectForRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey;
+- (id)peekObjectForRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey;
+- (void)setObject:(id)object forRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey generation:(uint64_t)generation;
+- (void)updateObject:(id)object forRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey;
+- (void)removeObjectsForRecordIds:(NSArray *)recordIds datasetKey:(NSArray *)datasetKey;
+- (void)removeDataset:(NSArray *)datasetKey;
+- (void)removeAllObjects;
+
+@end
+
 @interface AWSCognitoSQLiteManager()
 {
 }
 
 @property (nonatomic, assign) sqlite3 *sqlite;
+@property (nonatomic, strong) AWSCognitoSQLiteConnection *writeConnection;
+
+// Idle read-only connections, only used when concurrent reads are enabled
+@property (nonatomic, strong) NSMutableArray *readConnections;
+@property (atomic, assign) NSUInteger readConnectionCount;
+
+// Only set when the record cache is enabled
+@property (atomic, strong) AWSCognitoRecordCache *recordCache;
 
 // iOS 6 and later, dispatch_queue_t is an Objective-C object.
 #if OS_OBJECT_USE_OBJC
 @property (nonatomic, strong) dispatch_queue_t dispatchQueue;
+@property (atomic, strong) dispatch_semaphore_t readSemaphore;
 #else
 @property (nonatomic, assign) dispatch_queue_t dispatchQueue;
+@property (atomic, assign) dispatch_semaphore_t readSemaphore;
 #endif
 
++ (NSString *)sqlForStatement:(AWSCognitoSQLiteStatement)statementType;
++ (NSString *)recordStorageSQL:(NSString *)prefix;
++ (NSString *)localRecordCountSQLForIdentity:(NSString *)identity dataset:(NSString *)dataset;
++ (NSString *)localDataStorageSQLForIdentity:(NSString *)identity dataset:(NSString *)dataset;
+
+@end
+
+@implementation AWSCognitoSQLiteConnection
+
+- (instancetype)initWithSQLite:(sqlite3 *)sqlite {
+    if (self = [super init]) {
+        _sqlite = sqlite;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self finalizeStatements];
+}
+
+/**
+ * Returns the prepared statement for the given operation, preparing it on first use.
+ * The statement must be handed back to resetStatement: once the caller is done stepping through it.
+ **/
+- (sqlite3_stmt *)statement:(AWSCognitoSQLiteStatement)statementType {
+    if (_statements[statementType] == NULL && self.sqlite != NULL) {
+        NSString *sqlString = [AWSCognitoSQLiteManager sqlForStatement:statementType];
+        AWSLogDebug(@"Preparing statement = '%@'", sqlString);
+
+        sqlite3_stmt *statement = NULL;
+        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        {
+            _statements[statementType] = statement;
+        }
+        else
+        {
+            AWSLogInfo(@"Error creating statement: %s", sqlite3_errmsg(self.sqlite));
+            sqlite3_finalize(statement);
+        }
+    }
+    return _statements[statementType];
+}
+
+- (void)prepareStatements {
+    for (NSInteger i = 0; i < AWSCognitoSQLiteStatementCount; i++) {
+        [self statement:i];
+    }
+}
+
+- (void)finalizeStatements {
+    for (NSInteger i = 0; i < AWSCognitoSQLiteStatementCount; i++) {
+        sqlite3_finalize(_statements[i]);
+        _statements[i] = NULL;
+    }
+}
+
+- (void)close {
+    [self finalizeStatements];
+    sqlite3_close(_sqlite);
+    _sqlite = NULL;
+}
+
+@end
+
+@implementation AWSCognitoRecordCache
+
+- (instancetype)initWithCountLimit:(NSUInteger)countLimit {
+    if (self = [super init]) {
+        _countLimit = countLimit;
+        _datasets = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (NSUInteger)hits {
+    @synchronized(self) {
+        return _hits;
+    }
+}
+
+- (NSUInteger)misses {
+    @synchronized(self) {
+        return _misses;
+    }
+}
+
+- (uint64_t)generation {
+    @synchronized(self) {
+        return _generation;
+    }
+}
+
+/**
+ * Returns the cached record or NSNull, or nil on a miss. Counts towards the hit rate.
+ **/
+- (id)objectForRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey {
+    @synchronized(self) {
+        id object = [[_datasets objectForKey:datasetKey] objectForKey:recordId];
+        if (object != nil) {
+            _hits++;
+        } else {
+            _misses++;
+        }
+        return object;
+    }
+}
+
+- (id)peekObjectForRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey {
+    @synchronized(self) {
+        return [[_datasets objectForKey:datasetKey] objectForKey:recordId];
+    }
+}
+
+- (void)storeObject:(id)object forRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey {
+    NSCache *records = [_datasets objectForKey:datasetKey];
+    if (records == nil) {
+        records = [NSCache new];
+        records.countLimit = self.countLimit;
+        [_datasets setObject:records forKey:datasetKey];
+    }
+    [records setObject:object forKey:recordId];
+}
+
+- (void)setObject:(id)object forRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey generation:(uint64_t)generation {
+    @synchronized(self) {
+        if (generation == _generation) {
+            [self storeObject:object forRecordId:recordId datasetKey:datasetKey];
+        }
+    }
+}
+
+- (void)updateObject:(id)object forRecordId:(NSString *)recordId datasetKey:(NSArray *)datasetKey {
+    @synchronized(self) {
+        _generation++;
+        [self storeObject:object forRecordId:recordId datasetKey:datasetKey];
+    }
+}
+
+- (void)removeObjectsForRecordIds:(NSArray *)recordIds datasetKey:(NSArray *)datasetKey {
+    @synchronized(self) {
+        _generation++;
+        NSCache *records = [_datasets objectForKey:datasetKey];
+        for (NSString *recordId in recordIds) {
+            [records removeObjectForKey:recordId];
+        }
+    }
+}
+
+- (void)removeDataset:(NSArray *)datasetKey {
+    @synchronized(self) {
+        _generation++;
+        [_datasets removeObjectForKey:datasetKey];
+    }
+}
+
+- (void)removeAllObjects {
+    @synchronized(self) {
+        _generation++;
+        [_datasets removeAllObjects];
+    }
+}
+
 @end
 
 @implementation AWSCognitoSQLiteManager
@@ -41,24 +291,36 @@
         _identityId = identityId;
         _deviceId = deviceId;
         _dispatchQueue = dispatch_queue_create("com.amazon.cognito.SerialDispatchQueue", DISPATCH_QUEUE_SERIAL);
+        _readConnections = [NSMutableArray new];
 
         [self setupSQL];
         [self initializeTables];
+        [self prepareStatements];
     }
 
     return self;
 }
 
+- (void)dealloc {
+    [self closeReadConnections];
+    [_writeConnection close];
+}
+
 - (void)setupSQL {
     
     
     if(sqlite3_open([[self filePath] UTF8String], &_sqlite) != SQLITE_OK)
     {
         sqlite3_close(_sqlite);
+        _sqlite = NULL;
         AWSLogInfo(@"SQLite setup failed.");
 
         return;
     }
+
+    // INSERT OR REPLACE into CognitoData only fires the delete trigger that keeps the
+    // local counters in step for the replaced row when recursive triggers are on
+    sqlite3_exec(_sqlite, "PRAGMA recursive_triggers = ON", NULL, NULL, NULL);
 }
 
 - (void)deleteAllData {
@@ -95,6 +357,7 @@
         }
         sqlite3_reset(statement);
         sqlite3_finalize(statement);
+        [self.recordCache removeAllObjects];
     });
 }
 
@@ -131,6 +394,7 @@
         if(sqlite3_exec(_sqlite, [createString UTF8String], NULL, NULL, &error) != SQLITE_OK)
         {
             sqlite3_close(_sqlite);
+            _sqlite = NULL;
             AWSLogInfo(@"SQLite setup failed: %s", error);
             
             return;
@@ -160,26 +424,435 @@
         if(sqlite3_exec(_sqlite, [createString2 UTF8String], NULL, NULL, &error) != SQLITE_OK)
         {
             sqlite3_close(_sqlite);
+            _sqlite = NULL;
             AWSLogInfo(@"SQLite setup failed: %s", error);
             
             return;
         }
         
+        [self migrateSchema];
+    });
+}
+
+#pragma mark - Prepared statements
+
+- (void)prepareStatements {
+    dispatch_sync(self.dispatchQueue, ^{
+        self.writeConnection = [[AWSCognitoSQLiteConnection alloc] initWithSQLite:self.sqlite];
+        [self.writeConnection prepareStatements];
     });
 }
 
+/**
+ * Returns the prepared statement for the given operation on the write connection.
+ * Must be called on the dispatch queue.
+ **/
+- (sqlite3_stmt *)statement:(AWSCognitoSQLiteStatement)statementType {
+    return [self.writeConnection statement:statementType];
+}
+
++ (NSString *)sqlForStatement:(AWSCognitoSQLiteStatement)statementType {
+    switch (statementType) {
+        case AWSCognitoSQLiteStatementInitializeDataset:
+            // records can already exist locally if the metadata was removed on its own
+            return [NSString stringWithFormat:@"INSERT INTO %@(%@,%@,%@,%@,%@) SELECT ?1, ?2, ?3, %@, %@ WHERE NOT EXISTS (SELECT 1 FROM %@ WHERE %@ = ?3 AND %@ = ?1)",
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoLocalRecordCountFieldName,
+                    AWSCognitoLocalDataStorageFieldName,
+                    [self localRecordCountSQLForIdentity:@"?3" dataset:@"?1"],
+                    [self localDataStorageSQLForIdentity:@"?3" dataset:@"?1"],
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementGetDatasets:
+            return [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ?",
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoLastSyncCount,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoDatasetCreationDateFieldName,
+                    AWSCognitoDataStorageFieldName,
+                    AWSCognitoRecordCountFieldName,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName];
+
+        case AWSCognitoSQLiteStatementLoadDatasetMetadata:
+            return [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ? and %@ = ?",
+                    AWSCognitoLastSyncCount,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoDatasetCreationDateFieldName,
+                    AWSCognitoDataStorageFieldName,
+                    AWSCognitoRecordCountFieldName,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoDatasetFieldName];
+
+        case AWSCognitoSQLiteStatementPutDatasetMetadata:
+            return [NSString stringWithFormat:@"INSERT INTO %@(%@,%@,%@,%@,%@,%@,%@,%@,%@) SELECT ?1, ?2, ?3, ?4, ?5, ?6, ?7, %@, %@ WHERE NOT EXISTS (SELECT 1 FROM %@ WHERE %@ = ?1 AND %@ = ?2)",
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoDatasetCreationDateFieldName,
+                    AWSCognitoDataStorageFieldName,
+                    AWSCognitoRecordCountFieldName,
+                    AWSCognitoLocalRecordCountFieldName,
+                    AWSCognitoLocalDataStorageFieldName,
+                    [self localRecordCountSQLForIdentity:@"?1" dataset:@"?2"],
+                    [self localDataStorageSQLForIdentity:@"?1" dataset:@"?2"],
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementUpdateDatasetMetadata:
+            // refreshes the remote side of a row that already existed
+            return [NSString stringWithFormat:@"UPDATE %@ SET %@ = ?3, %@ = ?4, %@ = ?5, %@ = ?6 WHERE %@ = ?1 AND %@ = ?2",
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoDataStorageFieldName,
+                    AWSCognitoRecordCountFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementGetRecord:
+            return [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ? AND %@ = ? AND %@ = ?",
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoTypeFieldName,
+                    AWSCognitoSyncCountFieldName,
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementDirtyRecords:
+            // served by the partial CognitoDataDirty index where SQLite supports it
+            return [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ != 0 AND %@ = ? AND %@ = ?",
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoTypeFieldName,
+                    AWSCognitoSyncCountFieldName,
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementAllRecords:
+            return [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ? AND %@ = ?",
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoTypeFieldName,
+                    AWSCognitoSyncCountFieldName,
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementPutRecord:
+            /**
+             * Inserts a new record or replaces the current record with a given record.
+             * Increment the dirty count if we are updating the data.
+             */
+            return [NSString stringWithFormat:
+                    @"INSERT OR REPLACE INTO %@ ( \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@ \
+                    ) VALUES ( \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    COALESCE((SELECT %@ FROM %@ WHERE %@ = ? AND %@ = ? AND %@ = ?)+1, 1), \
+                    ?, \
+                    ? )",
+
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoTypeFieldName,
+                    AWSCognitoSyncCountFieldName,
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName,
+
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementConditionalUpdateRecord:
+            return [NSString stringWithFormat:
+                    @"UPDATE %@ SET \
+                    %@ = ?, \
+                    %@ = ?, \
+                    %@ = ?, \
+                    %@ = ?, \
+                    %@ = ?, \
+                    %@ = ? \
+                    WHERE %@ = ? \
+                    AND %@ = ? \
+                    AND %@ = ? \
+                    AND %@ = ? \
+                    AND %@ = ? \
+                    AND %@ = ? \
+                    AND %@ = ? \
+                    AND %@ = ? \
+                    ",
+
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoTypeFieldName,
+                    AWSCognitoSyncCountFieldName,
+                    AWSCognitoDirtyFieldName,
+
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoSyncCountFieldName,
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementConditionalInsertRecord:
+            return [NSString stringWithFormat:
+                    @"INSERT INTO %@ ( \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@, \
+                    %@ \
+                    ) VALUES ( \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ?, \
+                    ? \
+                    )",
+
+                    AWSCognitoDefaultSqliteDataTableName,
+
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoTypeFieldName,
+                    AWSCognitoSyncCountFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoDirtyFieldName];
+
+        case AWSCognitoSQLiteStatementFlagRecordAsDeleted:
+            return [NSString stringWithFormat:
+                    @"UPDATE %@ SET \
+                    %@ = %lld, \
+                    %@ = ?, \
+                    %@ = ?, \
+                    %@ = ?, \
+                    %@ = ? \
+                    WHERE %@ = ? AND %@ = ? AND %@ = ?",
+                    AWSCognitoDefaultSqliteDataTableName,
+
+                    AWSCognitoDirtyFieldName,
+                    AWSCognitoNotSyncedDeletedRecordDirty,
+
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoRecordValueName,
+                    AWSCognitoTypeFieldName,
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementDeleteRecord:
+            return [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ? AND %@ = ? AND %@ = ?",
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoTableRecordKeyName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementNumRecords:
+            return [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE %@=? AND %@ = ?",
+                    AWSCognitoLocalRecordCountFieldName,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoTableIdentityKeyName];
+
+        case AWSCognitoSQLiteStatementLocalDataStorage:
+            return [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE %@=? AND %@ = ?",
+                    AWSCognitoLocalDataStorageFieldName,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoTableIdentityKeyName];
+
+        case AWSCognitoSQLiteStatementLastSyncCount:
+            return [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE %@=? AND %@ = ?",
+                    AWSCognitoLastSyncCount,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoTableIdentityKeyName];
+
+        case AWSCognitoSQLiteStatementUpdateLastSyncCount:
+            // the replaced row carries the rest of its columns over, recomputing the local
+            // counters when the dataset has no metadata yet
+            return [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@(%@,%@,%@,%@,%@,%@,%@,%@,%@,%@,%@) SELECT ?1, ?2, ?3, ?4, IFNULL(old.%@, 0), IFNULL(old.%@, 0), IFNULL(old.%@, 0), IFNULL(old.%@, 0), IFNULL(old.%@, %@), IFNULL(old.%@, %@), old.%@ FROM (SELECT 1) LEFT JOIN %@ AS old ON old.%@ = ?3 AND old.%@ = ?1",
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoLastSyncCount,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoModifiedByFieldName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoDatasetCreationDateFieldName,
+                    AWSCognitoDataStorageFieldName,
+                    AWSCognitoRecordCountFieldName,
+                    AWSCognitoLocalRecordCountFieldName,
+                    AWSCognitoLocalDataStorageFieldName,
+                    AWSCognitoPulledLastModifiedFieldName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoDatasetCreationDateFieldName,
+                    AWSCognitoDataStorageFieldName,
+                    AWSCognitoRecordCountFieldName,
+                    AWSCognitoLocalRecordCountFieldName,
+                    [self localRecordCountSQLForIdentity:@"?3" dataset:@"?1"],
+                    AWSCognitoLocalDataStorageFieldName,
+                    [self localDataStorageSQLForIdentity:@"?3" dataset:@"?1"],
+                    AWSCognitoPulledLastModifiedFieldName,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementPullState:
+            return [NSString stringWithFormat:@"SELECT %@, %@ = %@ FROM %@ WHERE %@ = ? AND %@ = ?",
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoPulledLastModifiedFieldName,
+                    AWSCognitoLastModifiedFieldName,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementUpdatePulledLastModified:
+            return [NSString stringWithFormat:@"UPDATE %@ SET %@ = ? WHERE %@ = ? AND %@ = ?",
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoPulledLastModifiedFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementSyncCheckpoint:
+            return [NSString stringWithFormat:@"SELECT %@, %@, %@, %@ FROM %@ WHERE %@ = ? AND %@ = ? AND %@ IS NOT NULL",
+                    AWSCognitoCheckpointSyncCountFieldName,
+                    AWSCognitoCheckpointSessionTokenFieldName,
+                    AWSCognitoCheckpointNextTokenFieldName,
+                    AWSCognitoCheckpointAppliedSyncCountFieldName,
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName,
+                    AWSCognitoCheckpointNextTokenFieldName];
+
+        case AWSCognitoSQLiteStatementUpdateSyncCheckpoint:
+            return [NSString stringWithFormat:@"UPDATE %@ SET %@ = ?, %@ = ?, %@ = ?, %@ = ? WHERE %@ = ? AND %@ = ?",
+                    AWSCognitoDefaultSqliteMetadataTableName,
+                    AWSCognitoCheckpointSyncCountFieldName,
+                    AWSCognitoCheckpointSessionTokenFieldName,
+                    AWSCognitoCheckpointNextTokenFieldName,
+                    AWSCognitoCheckpointAppliedSyncCountFieldName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementDeleteDatasetRecords:
+            return [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ? AND %@ = ?",
+                    AWSCognitoDefaultSqliteDataTableName,
+                    AWSCognitoTableIdentityKeyName,
+                    AWSCognitoTableDatasetKeyName];
+
+        case AWSCognitoSQLiteStatementCount:
+            break;
+    }
+    return nil;
+}
+
+/**
+ * Bytes a record counts against the dataset size, matching -[AWSCognitoDataset sizeForRecord:]:
+ * the UTF-8 key plus the stored value, which is empty for a deleted record.
+ * The prefix qualifies the columns, e.g. NEW. or OLD. inside a trigger.
+ **/
++ (NSString *)recordStorageSQL:(NSString *)prefix {
+    return [NSString stringWithFormat:@"LENGTH(CAST(%@%@ AS BLOB)) + LENGTH(CAST(%@%@ AS BLOB))",
+            prefix, AWSCognitoTableRecordKeyName,
+            prefix, AWSCognitoRecordValueName];
+}
+
+/**
+ * Scalar subqueries recomputing the local counters of one dataset from its records, for the
+ * identity and dataset given as SQL expressions.
+ **/
++ (NSString *)localRecordCountSQLForIdentity:(NSString *)identity dataset:(NSString *)dataset {
+    return [NSString stringWithFormat:@"(SELECT COUNT(*) FROM %@ WHERE %@ = %@ AND %@ = %@)",
+            AWSCognitoDefaultSqliteDataTableName,
+            AWSCognitoTableIdentityKeyName, identity,
+            AWSCognitoTableDatasetKeyName, dataset];
+}
+
++ (NSString *)localDataStorageSQLForIdentity:(NSString *)identity dataset:(NSString *)dataset {
+    return [NSString stringWithFormat:@"(SELECT IFNULL(SUM(%@), 0) FROM %@ WHERE %@ = %@ AND %@ = %@)",
+            [self recordStorageSQL:@""],
+            AWSCognitoDefaultSqliteDataTableName,
+            AWSCognitoTableIdentityKeyName, identity,
+            AWSCognitoTableDatasetKeyName, dataset];
+}
+
+/**
+ * Resets a cached statement and clears its bindings so it can be reused
+ **/
+- (void)resetStatement:(sqlite3_stmt *) statement {
+    if (statement == NULL) {
+        return;
+    }
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+}
+
 - (void)initializeDatasetTables:(NSString *) datasetName {
     
     dispatch_sync(self.dispatchQueue, ^{
-        NSString *sqlString = [NSString stringWithFormat:@"INSERT INTO %@(%@,%@,%@) VALUES (?,?,?)",
-                               AWSCognitoDefaultSqliteMetadataTableName,
-                               AWSCognitoTableDatasetKeyName,
-                               AWSCognitoModifiedByFieldName,
-                               AWSCognitoTableIdentityKeyName];
-        AWSLogDebug(@"sqlString = '%@'", sqlString);
-        sqlite3_stmt *statement;
+        sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementInitializeDataset];
         
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 2, [[self deviceId] UTF8String], -1, SQLITE_TRANSIENT);
@@ -196,32 +869,548 @@
         {
             AWSLogInfo(@"Error initializing sync count: %s", sqlite3_errmsg(self.sqlite));
         }
-        sqlite3_reset(statement);
+        [self resetStatement:statement];
+    });
+}
+
+#pragma mark - Schema migrations
+
+/**
+ * Must be called on the dispatch queue.
+ **/
+- (int)userVersion {
+    int version = 0;
+    sqlite3_stmt *statement = NULL;
+    if(sqlite3_prepare_v2(self.sqlite, "PRAGMA user_version", -1, &statement, NULL) == SQLITE_OK
+       && sqlite3_step(statement) == SQLITE_ROW)
+    {
+        version = sqlite3_column_int(statement, 0);
+    }
+    sqlite3_finalize(statement);
+    return version;
+}
+
+/**
+ * Brings the database up to AWSCognitoSQLiteSchemaVersion, one step at a time. Each step runs
+ * in its own transaction together with the user_version bump, so a step that fails or is
+ * interrupted leaves the database at the previous version and is resumed on the next open.
+ * Must be called on the dispatch queue.
+ **/
+- (void)migrateSchema {
+    int version = [self userVersion];
+    while (version < AWSCognitoSQLiteSchemaVersion) {
+        int targetVersion = version + 1;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        
+        if (sqlite3_exec(self.sqlite, "BEGIN EXCLUSIVE TRANSACTION", NULL, NULL, NULL) != SQLITE_OK) {
+            AWSLogError(@"Unable to begin schema migration to version %d: %s", targetVersion, sqlite3_errmsg(self.sqlite));
+            return;
+        }
+        
+        BOOL result = [self migrateToVersion:targetVersion];
+        if (result) {
+            NSString *versionString = [NSString stringWithFormat:@"PRAGMA user_version = %d", targetVersion];
+            result = sqlite3_exec(self.sqlite, [versionString UTF8String], NULL, NULL, NULL) == SQLITE_OK
+                && sqlite3_exec(self.sqlite, "COMMIT", NULL, NULL, NULL) == SQLITE_OK;
+        }
+        if (!result) {
+            sqlite3_exec(self.sqlite, "ROLLBACK", NULL, NULL, NULL);
+            AWSLogInfo(@"Schema migration to version %d did not complete after %.1fms, it will be retried on the next launch",
+                       targetVersion, (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+            return;
+        }
+        
+        AWSLogInfo(@"Migrated local database to schema version %d in %.1fms", targetVersion, (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+        version = targetVersion;
+    }
+}
+
+/**
+ * Runs the step that upgrades a database from the previous version to the given one, inside
+ * the transaction opened by migrateSchema. New steps are added here along with a new
+ * AWSCognitoSQLiteSchemaVersion.
+ **/
+- (BOOL)migrateToVersion:(int)version {
+    if (version == AWSCognitoSQLiteRawValueFormatVersion) {
+        return [self migrateRecordValuesToRawFormat];
+    }
+    if (version == AWSCognitoSQLiteLocalCountersVersion) {
+        return [self addLocalCounters];
+    }
+    if (version == AWSCognitoSQLiteDirtyRecordIndexVersion) {
+        return [self addDirtyRecordIndex];
+    }
+    if (version == AWSCognitoSQLitePullTrackingVersion) {
+        return [self addPullTracking];
+    }
+    if (version == AWSCognitoSQLiteSyncCheckpointVersion) {
+        return [self addSyncCheckpoint];
+    }
+    AWSLogError(@"No schema migration to version %d", version);
+    return NO;
+}
+
+/**
+ * Databases before AWSCognitoSQLiteRawValueFormatVersion stored every value as a {"v": value}
+ * JSON document. Rewrites those rows in the raw format.
+ **/
+- (BOOL)migrateRecordValuesToRawFormat {
+    // decode everything first so the table isn't modified while it is being read
+    NSMutableArray *rowIds = [NSMutableArray new];
+    NSMutableArray *values = [NSMutableArray new];
+    BOOL result = YES;
+    
+    NSString *selectString = [NSString stringWithFormat:@"SELECT rowid, %@, %@ FROM %@",
+                              AWSCognitoRecordValueName,
+                              AWSCognitoTypeFieldName,
+                              AWSCognitoDefaultSqliteDataTableName];
+    sqlite3_stmt *statement = NULL;
+    if(sqlite3_prepare_v2(self.sqlite, [selectString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+    {
+        while (sqlite3_step(statement) == SQLITE_ROW)
+        {
+            const char *jsonChars = (const char *)sqlite3_column_text(statement, 1);
+            NSString *json = jsonChars ? [[NSString alloc] initWithUTF8String:jsonChars] : nil;
+            AWSCognitoRecordValue *value = [[AWSCognitoRecordValue alloc] initWithJson:json type:(int)sqlite3_column_int64(statement, 2)];
+            
+            [rowIds addObject:[NSNumber numberWithLongLong:sqlite3_column_int64(statement, 0)]];
+            [values addObject:value];
+        }
+    }
+    else
+    {
+        AWSLogError(@"Error reading records for migration: %s", sqlite3_errmsg(self.sqlite));
+        result = NO;
+    }
+    sqlite3_finalize(statement);
+    statement = NULL;
+    
+    if (result && [rowIds count] > 0) {
+        NSString *updateString = [NSString stringWithFormat:@"UPDATE %@ SET %@ = ? WHERE rowid = ?",
+                                  AWSCognitoDefaultSqliteDataTableName,
+                                  AWSCognitoRecordValueName];
+        if(sqlite3_prepare_v2(self.sqlite, [updateString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        {
+            for (NSUInteger i = 0; i < [rowIds count]; i++) {
+                [self bindRecordValue:values[i] statement:statement index:1];
+                sqlite3_bind_int64(statement, 2, [rowIds[i] longLongValue]);
+                if (sqlite3_step(statement) != SQLITE_DONE) {
+                    AWSLogError(@"Error migrating record value: %s", sqlite3_errmsg(self.sqlite));
+                    result = NO;
+                    break;
+                }
+                sqlite3_reset(statement);
+            }
+        }
+        else
+        {
+            AWSLogError(@"Error creating migration statement: %s", sqlite3_errmsg(self.sqlite));
+            result = NO;
+        }
+        sqlite3_finalize(statement);
+    }
+    
+    if (result) {
+        AWSLogDebug(@"Migrated %lu record values to the raw storage format", (unsigned long)[rowIds count]);
+    }
+    return result;
+}
+
+/**
+ * Adds the LocalRecordCount and LocalDataStorage columns to CognitoMetadata, fills them from
+ * the existing records and installs the triggers that keep them current on every insert,
+ * replace, update and delete of CognitoData. Reparenting moves a dataset's metadata row
+ * together with its records, so changes to the identity or dataset columns are not tracked.
+ **/
+- (BOOL)addLocalCounters {
+    NSMutableArray *migration = [NSMutableArray new];
+    
+    // ALTER TABLE can't be repeated, so only add the columns if they are missing
+    NSString *selectString = [NSString stringWithFormat:@"SELECT %@, %@ FROM %@",
+                              AWSCognitoLocalRecordCountFieldName,
+                              AWSCognitoLocalDataStorageFieldName,
+                              AWSCognitoDefaultSqliteMetadataTableName];
+    sqlite3_stmt *statement = NULL;
+    if (sqlite3_prepare_v2(self.sqlite, [selectString UTF8String], -1, &statement, NULL) != SQLITE_OK) {
+        [migration addObject:[NSString stringWithFormat:@"ALTER TABLE %@ ADD COLUMN %@ INTEGER NOT NULL DEFAULT 0",
+                              AWSCognitoDefaultSqliteMetadataTableName,
+                              AWSCognitoLocalRecordCountFieldName]];
+        [migration addObject:[NSString stringWithFormat:@"ALTER TABLE %@ ADD COLUMN %@ INTEGER NOT NULL DEFAULT 0",
+                              AWSCognitoDefaultSqliteMetadataTableName,
+                              AWSCognitoLocalDataStorageFieldName]];
+    }
+    sqlite3_finalize(statement);
+    
+    NSString *newRecordStorage = [AWSCognitoSQLiteManager recordStorageSQL:@"NEW."];
+    NSString *oldRecordStorage = [AWSCognitoSQLiteManager recordStorageSQL:@"OLD."];
+    [migration addObjectsFromArray:@[
+        [NSString stringWithFormat:@"UPDATE %@ SET %@ = %@, %@ = %@",
+         AWSCognitoDefaultSqliteMetadataTableName,
+         AWSCognitoLocalRecordCountFieldName,
+         [AWSCognitoSQLiteManager localRecordCountSQLForIdentity:[NSString stringWithFormat:@"%@.%@", AWSCognitoDefaultSqliteMetadataTableName, AWSCognitoTableIdentityKeyName]
+                                                          dataset:[NSString stringWithFormat:@"%@.%@", AWSCognitoDefaultSqliteMetadataTableName, AWSCognitoTableDatasetKeyName]],
+         AWSCognitoLocalDataStorageFieldName,
+         [AWSCognitoSQLiteManager localDataStorageSQLForIdentity:[NSString stringWithFormat:@"%@.%@", AWSCognitoDefaultSqliteMetadataTableName, AWSCognitoTableIdentityKeyName]
+                                                          dataset:[NSString stringWithFormat:@"%@.%@", AWSCognitoDefaultSqliteMetadataTableName, AWSCognitoTableDatasetKeyName]]],
+        // the update misses when the dataset has no metadata yet, in which case the row is
+        // created from the records already stored, the new one included
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS CognitoDataInsertCounters AFTER INSERT ON %@ BEGIN \
+         UPDATE %@ SET %@ = %@ + 1, %@ = %@ + %@ WHERE %@ = NEW.%@ AND %@ = NEW.%@; \
+         INSERT INTO %@(%@,%@,%@,%@,%@) SELECT NEW.%@, NEW.%@, '', %@, %@ WHERE NOT EXISTS (SELECT 1 FROM %@ WHERE %@ = NEW.%@ AND %@ = NEW.%@); \
+         END",
+         AWSCognitoDefaultSqliteDataTableName,
+         AWSCognitoDefaultSqliteMetadataTableName,
+         AWSCognitoLocalRecordCountFieldName, AWSCognitoLocalRecordCountFieldName,
+         AWSCognitoLocalDataStorageFieldName, AWSCognitoLocalDataStorageFieldName, newRecordStorage,
+         AWSCognitoTableIdentityKeyName, AWSCognitoTableIdentityKeyName,
+         AWSCognitoTableDatasetKeyName, AWSCognitoTableDatasetKeyName,
+         AWSCognitoDefaultSqliteMetadataTableName,
+         AWSCognitoTableIdentityKeyName,
+         AWSCognitoTableDatasetKeyName,
+         AWSCognitoModifiedByFieldName,
+         AWSCognitoLocalRecordCountFieldName,
+         AWSCognitoLocalDataStorageFieldName,
+         AWSCognitoTableIdentityKeyName, AWSCognitoTableDatasetKeyName,
+         [AWSCognitoSQLiteManager localRecordCountSQLForIdentity:[NSString stringWithFormat:@"NEW.%@", AWSCognitoTableIdentityKeyName]
+                                                          dataset:[NSString stringWithFormat:@"NEW.%@", AWSCognitoTableDatasetKeyName]],
+         [AWSCognitoSQLiteManager localDataStorageSQLForIdentity:[NSString stringWithFormat:@"NEW.%@", AWSCognitoTableIdentityKeyName]
+                                                          dataset:[NSString stringWithFormat:@"NEW.%@", AWSCognitoTableDatasetKeyName]],
+         AWSCognitoDefaultSqliteMetadataTableName,
+         AWSCognitoTableIdentityKeyName, AWSCognitoTableIdentityKeyName,
+         AWSCognitoTableDatasetKeyName, AWSCognitoTableDatasetKeyName],
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS CognitoDataDeleteCounters AFTER DELETE ON %@ BEGIN \
+         UPDATE %@ SET %@ = %@ - 1, %@ = %@ - (%@) WHERE %@ = OLD.%@ AND %@ = OLD.%@; \
+         END",
+         AWSCognitoDefaultSqliteDataTableName,
+         AWSCognitoDefaultSqliteMetadataTableName,
+         AWSCognitoLocalRecordCountFieldName, AWSCognitoLocalRecordCountFieldName,
+         AWSCognitoLocalDataStorageFieldName, AWSCognitoLocalDataStorageFieldName, oldRecordStorage,
+         AWSCognitoTableIdentityKeyName, AWSCognitoTableIdentityKeyName,
+         AWSCognitoTableDatasetKeyName, AWSCognitoTableDatasetKeyName],
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS CognitoDataUpdateCounters AFTER UPDATE OF %@, %@ ON %@ BEGIN \
+         UPDATE %@ SET %@ = %@ - (%@) + (%@) WHERE %@ = NEW.%@ AND %@ = NEW.%@; \
+         END",
+         AWSCognitoTableRecordKeyName, AWSCognitoRecordValueName,
+         AWSCognitoDefaultSqliteDataTableName,
+         AWSCognitoDefaultSqliteMetadataTableName,
+         AWSCognitoLocalDataStorageFieldName, AWSCognitoLocalDataStorageFieldName, oldRecordStorage, newRecordStorage,
+         AWSCognitoTableIdentityKeyName, AWSCognitoTableIdentityKeyName,
+         AWSCognitoTableDatasetKeyName, AWSCognitoTableDatasetKeyName]]];
+    
+    for (NSString *sqlString in migration) {
+        if (sqlite3_exec(self.sqlite, [sqlString UTF8String], NULL, NULL, NULL) != SQLITE_OK) {
+            AWSLogError(@"Error adding local counters: %s", sqlite3_errmsg(self.sqlite));
+            return NO;
+        }
+    }
+    return YES;
+}
+
+/**
+ * Indexes the dirty records of each dataset, so recordsUpdatedAfterLastSync: visits only the
+ * records it returns rather than the whole dataset. The index is partial to stay small, which
+ * needs SQLite 3.8.0 (iOS 8); older versions get a full index on the dirty state instead.
+ **/
+- (BOOL)addDirtyRecordIndex {
+    NSString *indexString = nil;
+    if (sqlite3_libversion_number() < 3008000) {
+        // without partial indexes, index every record by its dirty state so later steps can run
+        AWSLogDebug(@"SQLite %s does not support partial indexes, indexing all records by dirty state", sqlite3_libversion());
+        indexString = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS CognitoDataDirty ON %@(%@, %@, %@)",
+                       AWSCognitoDefaultSqliteDataTableName,
+                       AWSCognitoTableIdentityKeyName,
+                       AWSCognitoTableDatasetKeyName,
+                       AWSCognitoDirtyFieldName];
+    }
+    else {
+        // the condition must match the one in AWSCognitoSQLiteStatementDirtyRecords for the index to be used
+        indexString = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS CognitoDataDirty ON %@(%@, %@) WHERE %@ != 0",
+                       AWSCognitoDefaultSqliteDataTableName,
+                       AWSCognitoTableIdentityKeyName,
+                       AWSCognitoTableDatasetKeyName,
+                       AWSCognitoDirtyFieldName];
+    }
+    if (sqlite3_exec(self.sqlite, [indexString UTF8String], NULL, NULL, NULL) != SQLITE_OK) {
+        AWSLogError(@"Error adding dirty record index: %s", sqlite3_errmsg(self.sqlite));
+        return NO;
+    }
+    return YES;
+}
+
+/**
+ * Adds the PulledLastModified column to CognitoMetadata. It holds the remote last modified
+ * date, as stored by putDatasetMetadata:, that the last successful pull started from.
+ **/
+- (BOOL)addPullTracking {
+    // ALTER TABLE can't be repeated, so only add the column if it is missing
+    NSString *selectString = [NSString stringWithFormat:@"SELECT %@ FROM %@",
+                              AWSCognitoPulledLastModifiedFieldName,
+                              AWSCognitoDefaultSqliteMetadataTableName];
+    sqlite3_stmt *statement = NULL;
+    BOOL exists = sqlite3_prepare_v2(self.sqlite, [selectString UTF8String], -1, &statement, NULL) == SQLITE_OK;
+    sqlite3_finalize(statement);
+    if (exists) {
+        return YES;
+    }
+    
+    NSString *alterString = [NSString stringWithFormat:@"ALTER TABLE %@ ADD COLUMN %@ INTEGER",
+                             AWSCognitoDefaultSqliteMetadataTableName,
+                             AWSCognitoPulledLastModifiedFieldName];
+    if (sqlite3_exec(self.sqlite, [alterString UTF8String], NULL, NULL, NULL) != SQLITE_OK) {
+        AWSLogError(@"Error adding pull tracking: %s", sqlite3_errmsg(self.sqlite));
+        return NO;
+    }
+    return YES;
+}
+
+/**
+ * Adds the checkpoint columns to CognitoMetadata, which let a paged pull that was interrupted
+ * resume with the page it had not written yet. See syncCheckpoint:.
+ **/
+- (BOOL)addSyncCheckpoint {
+    NSDictionary *columns = @{AWSCognitoCheckpointSyncCountFieldName : @"INTEGER",
+                              AWSCognitoCheckpointSessionTokenFieldName : @"TEXT",
+                              AWSCognitoCheckpointNextTokenFieldName : @"TEXT",
+                              AWSCognitoCheckpointAppliedSyncCountFieldName : @"INTEGER"};
+    for (NSString *column in columns) {
+        // ALTER TABLE can't be repeated, so only add the columns that are missing
+        NSString *selectString = [NSString stringWithFormat:@"SELECT %@ FROM %@",
+                                  column,
+                                  AWSCognitoDefaultSqliteMetadataTableName];
+        sqlite3_stmt *statement = NULL;
+        BOOL exists = sqlite3_prepare_v2(self.sqlite, [selectString UTF8String], -1, &statement, NULL) == SQLITE_OK;
+        sqlite3_finalize(statement);
+        if (exists) {
+            continue;
+        }
+        
+        NSString *alterString = [NSString stringWithFormat:@"ALTER TABLE %@ ADD COLUMN %@ %@",
+                                 AWSCognitoDefaultSqliteMetadataTableName,
+                                 column,
+                                 columns[column]];
+        if (sqlite3_exec(self.sqlite, [alterString UTF8String], NULL, NULL, NULL) != SQLITE_OK) {
+            AWSLogError(@"Error adding sync checkpoint: %s", sqlite3_errmsg(self.sqlite));
+            return NO;
+        }
+    }
+    return YES;
+}
+
+#pragma mark - Storage format
+
+/**
+ * Binds a record value in the raw storage format: the UTF-8 bytes of a string value, or an
+ * empty string for a deleted record. The Type column tells the two apart.
+ **/
+- (void)bindRecordValue:(AWSCognitoRecordValue *)value statement:(sqlite3_stmt *)statement index:(int)index {
+    [self bindRecordString:value.string type:value.type statement:statement index:index];
+}
+
+- (void)bindRecordString:(NSString *)string type:(AWSCognitoRecordValueType)type statement:(sqlite3_stmt *)statement index:(int)index {
+    if (type == AWSCognitoRecordValueTypeDeleted) {
+        sqlite3_bind_text(statement, index, "", 0, SQLITE_STATIC);
+    }
+    else if (string == nil) {
+        sqlite3_bind_null(statement, index);
+    }
+    else {
+        sqlite3_bind_text(statement, index, [string UTF8String], (int)[string lengthOfBytesUsingEncoding:NSUTF8StringEncoding], SQLITE_TRANSIENT);
+    }
+}
+
+- (AWSCognitoRecordValue *)recordValueFromStatement:(sqlite3_stmt *)statement column:(int)column type:(int64_t)type {
+    if (type == AWSCognitoRecordValueTypeDeleted) {
+        return [[AWSCognitoRecordValue alloc] initWithString:nil type:AWSCognitoRecordValueTypeDeleted];
+    }
+    
+    NSString *string = nil;
+    const unsigned char *text = sqlite3_column_text(statement, column);
+    if (text != NULL) {
+        string = [[NSString alloc] initWithBytes:text length:sqlite3_column_bytes(statement, column) encoding:NSUTF8StringEncoding];
+    }
+    return [[AWSCognitoRecordValue alloc] initWithString:string type:(AWSCognitoRecordValueType)type];
+}
+
+#pragma mark - Concurrent reads
+
+- (BOOL)enableConcurrentReads:(NSUInteger)readConnections {
+    __block BOOL result = NO;
+
+    dispatch_sync(self.dispatchQueue, ^{
+        if (self.readConnectionCount > 0) {
+            result = YES;
+            return;
+        }
+        if (readConnections == 0 || self.sqlite == NULL) {
+            return;
+        }
+
+        // WAL lets readers on other connections proceed while the write connection holds a transaction
+        BOOL walEnabled = NO;
+        sqlite3_stmt *statement = NULL;
+        if(sqlite3_prepare_v2(self.sqlite, "PRAGMA journal_mode=WAL", -1, &statement, NULL) == SQLITE_OK
+           && sqlite3_step(statement) == SQLITE_ROW)
+        {
+            const char *journalMode = (const char *)sqlite3_column_text(statement, 0);
+            walEnabled = (journalMode != NULL && strcmp(journalMode, "wal") == 0);
+        }
         sqlite3_finalize(statement);
+
+        if (!walEnabled) {
+            AWSLogInfo(@"Unable to switch the local database to WAL mode: %s", sqlite3_errmsg(self.sqlite));
+            return;
+        }
+
+        for (NSUInteger i = 0; i < readConnections; i++) {
+            sqlite3 *readSqlite = NULL;
+            if(sqlite3_open_v2([[self filePath] UTF8String], &readSqlite, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK)
+            {
+                AWSLogInfo(@"Error opening read connection: %s", sqlite3_errmsg(readSqlite));
+                sqlite3_close(readSqlite);
+                break;
+            }
+            // readers only ever wait for a checkpoint, never for a write transaction
+            sqlite3_busy_timeout(readSqlite, 1000);
+            [self.readConnections addObject:[[AWSCognitoSQLiteConnection alloc] initWithSQLite:readSqlite]];
+        }
+
+        if ([self.readConnections count] > 0) {
+            self.readSemaphore = dispatch_semaphore_create([self.readConnections count]);
+            self.readConnectionCount = [self.readConnections count];
+            result = YES;
+        }
+    });
+
+    return result;
+}
+
+- (void)closeReadConnections {
+    NSUInteger count = self.readConnectionCount;
+    dispatch_semaphore_t readSemaphore = self.readSemaphore;
+    if (count == 0 || readSemaphore == nil) {
+        return;
+    }
+
+    // route new reads through the write connection, then wait for in-flight reads to check their connections back in
+    self.readConnectionCount = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        dispatch_semaphore_wait(readSemaphore, DISPATCH_TIME_FOREVER);
+    }
+    @synchronized(self.readConnections) {
+        for (AWSCognitoSQLiteConnection *connection in self.readConnections) {
+            [connection close];
+        }
+        [self.readConnections removeAllObjects];
+    }
+    for (NSUInteger i = 0; i < count; i++) {
+        dispatch_semaphore_signal(readSemaphore);
+    }
+    self.readSemaphore = nil;
+}
+
+/**
+ * Runs a read on an idle read-only connection when concurrent reads are enabled,
+ * otherwise on the write connection through the serial dispatch queue.
+ **/
+- (void)performRead:(void (^)(AWSCognitoSQLiteConnection *connection))readBlock {
+    dispatch_semaphore_t readSemaphore = self.readSemaphore;
+    if (self.readConnectionCount > 0 && readSemaphore != nil) {
+        dispatch_semaphore_wait(readSemaphore, DISPATCH_TIME_FOREVER);
+
+        AWSCognitoSQLiteConnection *connection = nil;
+        @synchronized(self.readConnections) {
+            connection = [self.readConnections lastObject];
+            if (connection) {
+                [self.readConnections removeLastObject];
+            }
+        }
+
+        if (connection) {
+            readBlock(connection);
+            @synchronized(self.readConnections) {
+                [self.readConnections addObject:connection];
+            }
+            dispatch_semaphore_signal(readSemaphore);
+            return;
+        }
+        dispatch_semaphore_signal(readSemaphore);
+    }
+
+    dispatch_sync(self.dispatchQueue, ^{
+        readBlock(self.writeConnection);
     });
 }
 
+#pragma mark - Record cache
+
+- (void)enableRecordCache:(NSUInteger)countLimit {
+    dispatch_sync(self.dispatchQueue, ^{
+        self.recordCache = countLimit > 0 ? [[AWSCognitoRecordCache alloc] initWithCountLimit:countLimit] : nil;
+    });
+}
+
+- (NSUInteger)recordCacheHits {
+    return self.recordCache.hits;
+}
+
+- (NSUInteger)recordCacheMisses {
+    return self.recordCache.misses;
+}
+
+- (NSArray *)cacheKeyForDataset:(NSString *)datasetName {
+    return @[[self identityId], datasetName];
+}
+
+/**
+ * Brings a cached record in line with what PutRecord stored, including the dirty count it
+ * incremented. Records that aren't cached are left to be read on demand.
+ * Must be called on the dispatch queue once the write is committed.
+ **/
+- (void)cacheWrittenRecord:(AWSCognitoRecord *)record datasetName:(NSString *)datasetName lastModified:(int64_t)lastModified {
+    AWSCognitoRecordCache *cache = self.recordCache;
+    if (cache == nil || record.recordId == nil || datasetName == nil) {
+        return;
+    }
+    
+    NSArray *datasetKey = [self cacheKeyForDataset:datasetName];
+    id cached = [cache peekObjectForRecordId:record.recordId datasetKey:datasetKey];
+    if (cached == nil) {
+        // still bump the generation so a read that raced this write isn't stored
+        [cache removeObjectsForRecordIds:@[record.recordId] datasetKey:datasetKey];
+        return;
+    }
+    
+    AWSCognitoRecord *stored = [[AWSCognitoRecord alloc] initWithId:record.recordId data:record.data];
+    stored.lastModified = [AWSCognitoUtil millisSinceEpochToDate:[NSNumber numberWithLongLong:lastModified]];
+    stored.lastModifiedBy = self.deviceId;
+    stored.syncCount = record.syncCount;
+    stored.dirtyCount = [cached isKindOfClass:[AWSCognitoRecord class]] ? [(AWSCognitoRecord *)cached dirtyCount] + 1 : 1;
+    [cache updateObject:stored forRecordId:record.recordId datasetKey:datasetKey];
+}
+
+/**
+ * Must be called on the dispatch queue once the change is committed or rolled back.
+ **/
+- (void)invalidateCachedRecords:(NSArray *)recordIds datasetName:(NSString *)datasetName {
+    if (datasetName != nil && [recordIds count] > 0) {
+        [self.recordCache removeObjectsForRecordIds:recordIds datasetKey:[self cacheKeyForDataset:datasetName]];
+    }
+}
+
+- (void)invalidateCachedDataset:(NSString *)datasetName {
+    if (datasetName != nil) {
+        [self.recordCache removeDataset:[self cacheKeyForDataset:datasetName]];
+    }
+}
+
 #pragma mark - Data manipulations
 
 - (NSArray *)getDatasets:(NSError **)error {
     __block NSMutableArray *datasets = [NSMutableArray array];
     
-    dispatch_sync(self.dispatchQueue, ^{
-        NSString *query = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ?",
-                           AWSCognitoTableDatasetKeyName,
-                           AWSCognitoLastSyncCount,
-                           AWSCognitoLastModifiedFieldName,
-                           AWSCognitoModifiedByFieldName,
-                           AWSCognitoDatasetCreationDateFieldName,
-                           AWSCognitoDataStorageFieldName,
-                           AWSCognitoRecordCountFieldName,
-                           AWSCognitoDefaultSqliteMetadataTableName,
-                           AWSCognitoTableIdentityKeyName];
-        
-        AWSLogDebug(@"query = '%@'", query);
-        
-        sqlite3_stmt *statement;
-        if(sqlite3_prepare_v2(self.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementGetDatasets];
+        if(statement != NULL)
         {
             NSString * identityId = [self identityId];
             
@@ -251,38 +1440,24 @@
         }
         else
         {
-            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(connection.sqlite));
             if(error != nil)
             {
-                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(connection.sqlite)]];
             }
         }
         
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
-    });
+        [self resetStatement:statement];
+    }];
     
     return datasets;
 }
 
 - (void)loadDatasetMetadata:(AWSCognitoDatasetMetadata *)metadata error:(NSError **)error {
     
-    dispatch_sync(self.dispatchQueue, ^{
-        NSString *query = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ? and %@ = ?",
-                           AWSCognitoLastSyncCount,
-                           AWSCognitoLastModifiedFieldName,
-                           AWSCognitoModifiedByFieldName,
-                           AWSCognitoDatasetCreationDateFieldName,
-                           AWSCognitoDataStorageFieldName,
-                           AWSCognitoRecordCountFieldName,
-                           AWSCognitoDefaultSqliteMetadataTableName,
-                           AWSCognitoTableIdentityKeyName,
-                           AWSCognitoDatasetFieldName];
-        
-        AWSLogDebug(@"query = '%@'", query);
-        
-        sqlite3_stmt *statement;
-        if(sqlite3_prepare_v2(self.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementLoadDatasetMetadata];
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, [self.identityId UTF8String], -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 2, [metadata.name UTF8String], -1, SQLITE_TRANSIENT);
@@ -306,16 +1481,15 @@
         }
         else
         {
-            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(connection.sqlite));
             if(error != nil)
             {
-                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(connection.sqlite)]];
             }
         }
-        
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
-    });
+        
+        [self resetStatement:statement];
+    }];
 }
 
 - (BOOL)putDatasetMetadata:(NSArray *)datasets error:(NSError **)error {
@@ -323,18 +1497,14 @@
     __block BOOL success = YES;
     
     dispatch_sync(self.dispatchQueue, ^{
-        NSString *sqlString = [NSString stringWithFormat:@"INSERT INTO %@(%@,%@,%@,%@,%@,%@,%@) VALUES (?,?,?,?,?,?,?)",
-                               AWSCognitoDefaultSqliteMetadataTableName,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoTableDatasetKeyName,
-                               AWSCognitoLastModifiedFieldName,
-                               AWSCognitoModifiedByFieldName,
-                               AWSCognitoDatasetCreationDateFieldName,
-                               AWSCognitoDataStorageFieldName,
-                               AWSCognitoRecordCountFieldName];
-        sqlite3_stmt *statement;
+        // a dataset missing from the listing may have been deleted remotely, so it has to be
+        // pulled before synchronize can skip it again
+        [self clearPulledLastModifiedExcept:[datasets valueForKey:@"datasetName"]];
         
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementPutDatasetMetadata];
+        sqlite3_stmt *updateStatement = [self statement:AWSCognitoSQLiteStatementUpdateDatasetMetadata];
+        
+        if(statement != NULL && updateStatement != NULL)
         {
             for (AWSCognitoSyncDataset *dataset in datasets) {
                 int64_t lastModified = [AWSCognitoUtil getTimeMillisForDate:dataset.lastModifiedDate];
@@ -355,13 +1525,28 @@
                     success = NO;
                 }
                 sqlite3_reset(statement);
+                
+                sqlite3_bind_text(updateStatement, 1, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(updateStatement, 2, [dataset.datasetName UTF8String], -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int64(updateStatement, 3, lastModified);
+                sqlite3_bind_text(updateStatement, 4, [dataset.lastModifiedBy UTF8String], -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int64(updateStatement, 5, [dataset.dataStorage longLongValue]);
+                sqlite3_bind_int64(updateStatement, 6, [dataset.numRecords longLongValue]);
+                
+                if(SQLITE_DONE != sqlite3_step(updateStatement))
+                {
+                    AWSLogInfo(@"Error while updating dataset metadata: %s", sqlite3_errmsg(self.sqlite));
+                    success = NO;
+                }
+                sqlite3_reset(updateStatement);
             }
         }
         else
         {
             AWSLogInfo(@"Error updating sync count: %s", sqlite3_errmsg(self.sqlite));
         }
-        sqlite3_finalize(statement);
+        [self resetStatement:statement];
+        [self resetStatement:updateStatement];
     });
     
     return success;
@@ -369,24 +1554,9 @@
 
 - (AWSCognitoRecord *)getRecordById_internal:(NSString *)recordId datasetName:(NSString *)datasetName error:(NSError **)error sync:(BOOL) sync{
     __block AWSCognitoRecord *record = nil;
-    void (^getRecord)() = ^{
-        NSString *query = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ? AND %@ = ? AND %@ = ?",
-                           AWSCognitoLastModifiedFieldName,
-                           AWSCognitoModifiedByFieldName,
-                           AWSCognitoRecordValueName,
-                           AWSCognitoTypeFieldName,
-                           AWSCognitoSyncCountFieldName,
-                           AWSCognitoDirtyFieldName,
-                           AWSCognitoDefaultSqliteDataTableName,
-                           AWSCognitoTableRecordKeyName,
-                           AWSCognitoTableIdentityKeyName,
-                           AWSCognitoTableDatasetKeyName
-                           ];
-        
-        AWSLogDebug(@"query = '%@'", query);
-        
-        sqlite3_stmt *statement;
-        if(sqlite3_prepare_v2(self.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+    void (^getRecord)(AWSCognitoSQLiteConnection *) = ^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementGetRecord];
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, [recordId UTF8String], -1, SQLITE_TRANSIENT);
             
@@ -397,47 +1567,135 @@
             
             if (sqlite3_step(statement) == SQLITE_ROW)
             {
-                int64_t lastMod = sqlite3_column_int64(statement, 0);
-                char *modByChars = (char *) sqlite3_column_text(statement, 1);
-                char *dataChars = (char *)sqlite3_column_text(statement, 2);
-                int64_t type = sqlite3_column_int64(statement, 3);
-                int64_t syncCount = sqlite3_column_int64(statement, 4);
-                int64_t dirtyInt = sqlite3_column_int64(statement, 5);
-                
-                NSString *modBy = [[NSString alloc] initWithUTF8String:modByChars];
-                NSString *data = [[NSString alloc] initWithUTF8String:dataChars];
-                
-                record = [[AWSCognitoRecord alloc] initWithId:recordId
-                                                         data:[[AWSCognitoRecordValue alloc]initWithJson:data type:(int)type]];
-                record.lastModifiedBy = modBy;
-                record.lastModified = [AWSCognitoUtil millisSinceEpochToDate:[NSNumber numberWithLongLong:lastMod]];
-                record.dirtyCount = dirtyInt;
-                record.syncCount = syncCount;
+                record = [self recordWithId:recordId statement:statement];
             }
         }
         else
         {
-            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(connection.sqlite));
             if(error != nil)
             {
-                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(connection.sqlite)]];
             }
         }
         
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
+        [self resetStatement:statement];
     };
     if(sync){
-        dispatch_sync(self.dispatchQueue, getRecord);
+        [self performRead:getRecord];
     }else{
-        getRecord();
+        getRecord(self.writeConnection);
     }
     
     return record;
 }
 
 - (AWSCognitoRecord *)getRecordById:(NSString *)recordId datasetName:(NSString *)datasetName error:(NSError **)error {
-    return [self getRecordById_internal:recordId datasetName:datasetName error:error sync:YES];
+    AWSCognitoRecordCache *cache = self.recordCache;
+    if (cache == nil || recordId == nil || datasetName == nil) {
+        return [self getRecordById_internal:recordId datasetName:datasetName error:error sync:YES];
+    }
+    
+    NSArray *datasetKey = [self cacheKeyForDataset:datasetName];
+    id cached = [cache objectForRecordId:recordId datasetKey:datasetKey];
+    if (cached != nil) {
+        // hand out a copy, callers are free to modify the record they get back
+        return cached == [NSNull null] ? nil : [(AWSCognitoRecord *)cached copy];
+    }
+    
+    uint64_t generation = cache.generation;
+    NSError *readError = nil;
+    AWSCognitoRecord *record = [self getRecordById_internal:recordId datasetName:datasetName error:&readError sync:YES];
+    if (readError == nil) {
+        [cache setObject:(record != nil ? [record copy] : [NSNull null]) forRecordId:recordId datasetKey:datasetKey generation:generation];
+    } else if (error != nil) {
+        *error = readError;
+    }
+    return record;
+}
+
+- (NSDictionary *)getRecordsByIds:(NSArray *)recordIds datasetName:(NSString *)datasetName error:(NSError **)error {
+    NSMutableDictionary *records = [NSMutableDictionary dictionaryWithCapacity:[recordIds count]];
+    if ([recordIds count] == 0) {
+        return records;
+    }
+    
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        // stay well under SQLITE_MAX_VARIABLE_NUMBER (999) per query
+        NSUInteger const batchSize = 500;
+        for (NSUInteger offset = 0; offset < [recordIds count]; offset += batchSize) {
+            NSArray *batch = [recordIds subarrayWithRange:NSMakeRange(offset, MIN(batchSize, [recordIds count] - offset))];
+            
+            NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:[batch count]];
+            for (NSUInteger i = 0; i < [batch count]; i++) {
+                [placeholders addObject:@"?"];
+            }
+            NSString *query = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ? AND %@ = ? AND %@ IN (%@)",
+                               AWSCognitoLastModifiedFieldName,
+                               AWSCognitoModifiedByFieldName,
+                               AWSCognitoRecordValueName,
+                               AWSCognitoTypeFieldName,
+                               AWSCognitoSyncCountFieldName,
+                               AWSCognitoDirtyFieldName,
+                               AWSCognitoTableRecordKeyName,
+                               AWSCognitoDefaultSqliteDataTableName,
+                               AWSCognitoTableIdentityKeyName,
+                               AWSCognitoTableDatasetKeyName,
+                               AWSCognitoTableRecordKeyName,
+                               [placeholders componentsJoinedByString:@","]];
+            
+            sqlite3_stmt *statement = NULL;
+            if(sqlite3_prepare_v2(connection.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+            {
+                sqlite3_bind_text(statement, 1, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(statement, 2, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
+                for (NSUInteger i = 0; i < [batch count]; i++) {
+                    sqlite3_bind_text(statement, (int)i + 3, [batch[i] UTF8String], -1, SQLITE_TRANSIENT);
+                }
+                
+                while (sqlite3_step(statement) == SQLITE_ROW)
+                {
+                    NSString *recordId = [[NSString alloc] initWithUTF8String:(char *)sqlite3_column_text(statement, 6)];
+                    [records setObject:[self recordWithId:recordId statement:statement] forKey:recordId];
+                }
+                sqlite3_finalize(statement);
+            }
+            else
+            {
+                AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(connection.sqlite));
+                if(error != nil)
+                {
+                    *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(connection.sqlite)]];
+                }
+                sqlite3_finalize(statement);
+                return;
+            }
+        }
+    }];
+    
+    return records;
+}
+
+/**
+ * Builds a record from the current row of a statement whose first six columns are
+ * LastModified, ModifiedBy, Data, Type, SyncCount and Dirty.
+ **/
+- (AWSCognitoRecord *)recordWithId:(NSString *)recordId statement:(sqlite3_stmt *)statement {
+    int64_t lastMod = sqlite3_column_int64(statement, 0);
+    char *modByChars = (char *) sqlite3_column_text(statement, 1);
+    int64_t type = sqlite3_column_int64(statement, 3);
+    int64_t syncCount = sqlite3_column_int64(statement, 4);
+    int64_t dirtyInt = sqlite3_column_int64(statement, 5);
+    
+    NSString *modBy = [[NSString alloc] initWithUTF8String:modByChars];
+    
+    AWSCognitoRecord *record = [[AWSCognitoRecord alloc] initWithId:recordId
+                                                               data:[self recordValueFromStatement:statement column:2 type:type]];
+    record.lastModifiedBy = modBy;
+    record.lastModified = [AWSCognitoUtil millisSinceEpochToDate:[NSNumber numberWithLongLong:lastMod]];
+    record.dirtyCount = dirtyInt;
+    record.syncCount = syncCount;
+    return record;
 }
 
 - (NSString *) identityId {
@@ -451,24 +1709,10 @@
 {
     __block NSMutableDictionary *newRecords = [NSMutableDictionary new];
 
-    dispatch_sync(self.dispatchQueue, ^{
-        NSString *query = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ != 0 AND %@ = ? AND %@ = ?",
-                           AWSCognitoTableRecordKeyName,
-                           AWSCognitoLastModifiedFieldName,
-                           AWSCognitoModifiedByFieldName,
-                           AWSCognitoRecordValueName,
-                           AWSCognitoTypeFieldName,
-                           AWSCognitoSyncCountFieldName,
-                           AWSCognitoDirtyFieldName,
-                           AWSCognitoDefaultSqliteDataTableName,
-                           AWSCognitoDirtyFieldName,
-                           AWSCognitoTableIdentityKeyName,
-                           AWSCognitoTableDatasetKeyName];
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementDirtyRecords];
 
-        sqlite3_stmt *statement;
-        
-        
-        if(sqlite3_prepare_v2(self.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        if(statement != NULL)
         {
             NSString * identityId = [self identityId];
             sqlite3_bind_text(statement, 1, [identityId UTF8String], -1, SQLITE_TRANSIENT);
@@ -479,17 +1723,15 @@
                 char *recordIDChars = (char *) sqlite3_column_text(statement, 0);
                 int64_t lastMod = sqlite3_column_int64(statement, 1);
                 char *modByChars = (char *) sqlite3_column_text(statement, 2);
-                char *dataChars = (char *)sqlite3_column_text(statement, 3);
                 int64_t type = sqlite3_column_int64(statement, 4);
                 int64_t syncCount = sqlite3_column_int64(statement, 5);
                 int64_t dirtyInt = sqlite3_column_int64(statement, 6);
                 
                 NSString *recordId = [[NSString alloc] initWithUTF8String:recordIDChars];
                 NSString *modBy = [[NSString alloc] initWithUTF8String:modByChars];
-                NSString *data = [[NSString alloc] initWithUTF8String:dataChars];
 
                 AWSCognitoRecord *record = [[AWSCognitoRecord alloc] initWithId:recordId
-                                                          data:[[AWSCognitoRecordValue alloc] initWithJson:data type:(int)type]];
+                                                          data:[self recordValueFromStatement:statement column:3 type:type]];
                 record.lastModifiedBy = modBy;
                 record.lastModified = [AWSCognitoUtil millisSinceEpochToDate:[NSNumber numberWithLongLong:lastMod]];
                 record.dirtyCount = dirtyInt;
@@ -500,13 +1742,15 @@
         }
         else
         {
-            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(connection.sqlite));
             if(error != nil)
             {
-                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(connection.sqlite)]];
             }
         }
-    });
+
+        [self resetStatement:statement];
+    }];
 
     return [NSDictionary dictionaryWithDictionary:newRecords];
 }
@@ -515,24 +1759,12 @@
 {
     __block NSMutableArray *allRecords = nil;
 
-    dispatch_sync(self.dispatchQueue, ^{
-
-        NSString *query = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@, %@, %@, %@ FROM %@ WHERE %@ = ? AND %@ = ?",
-                           AWSCognitoTableRecordKeyName,
-                           AWSCognitoLastModifiedFieldName,
-                           AWSCognitoModifiedByFieldName,
-                           AWSCognitoRecordValueName,
-                           AWSCognitoTypeFieldName,
-                           AWSCognitoSyncCountFieldName,
-                           AWSCognitoDirtyFieldName,
-                           AWSCognitoDefaultSqliteDataTableName,
-                           AWSCognitoTableIdentityKeyName,
-                           AWSCognitoTableDatasetKeyName];
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
 
         AWSCognitoRecord *record = nil;
 
-        sqlite3_stmt *statement;
-        if(sqlite3_prepare_v2(self.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementAllRecords];
+        if(statement != NULL)
         {
             NSString * identityId = [self identityId];
             sqlite3_bind_text(statement, 1, [identityId UTF8String], -1, SQLITE_TRANSIENT);
@@ -548,15 +1780,13 @@
                 char *recordIdChars = (char *) sqlite3_column_text(statement, 0);
                 int64_t lastMod = sqlite3_column_int64(statement, 1);
                 char *modByChars = (char *) sqlite3_column_text(statement, 2);
-                char *dataChars = (char *)sqlite3_column_text(statement, 3);
                 int64_t type = sqlite3_column_int64(statement, 4);
                 int64_t syncCount = sqlite3_column_int64(statement, 5);
                 int64_t dirtyInt = sqlite3_column_int64(statement, 6);
                 
                 NSString *modBy = [[NSString alloc] initWithUTF8String:modByChars];
-                NSString *dataString = [[NSString alloc] initWithUTF8String:dataChars];
                 NSString *recordId = [[NSString alloc] initWithUTF8String:recordIdChars];
-                AWSCognitoRecordValue *data = [[AWSCognitoRecordValue alloc] initWithJson:dataString type:(int)type];
+                AWSCognitoRecordValue *data = [self recordValueFromStatement:statement column:3 type:type];
 
                 record = [[AWSCognitoRecord alloc] initWithId:recordId data:data];
                 record.lastModifiedBy = modBy;
@@ -570,12 +1800,11 @@
         }
         else
         {
-            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error creating query statement: %s", sqlite3_errmsg(connection.sqlite));
         }
 
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
-    });
+        [self resetStatement:statement];
+    }];
 
     return allRecords;
 }
@@ -584,163 +1813,150 @@
     __block BOOL result = NO;
 
     dispatch_sync(self.dispatchQueue, ^{
-
-        sqlite3_stmt *statement;
-
         int64_t lastModified = [AWSCognitoUtil getTimeMillisForDate:[NSDate date]];
-        const char *recordID = [record.recordId UTF8String];
-        const char *lastModifiedBy = [self.deviceId UTF8String];
-        const char *data = [[record.data toJsonString] UTF8String];
-        const char *datasetNameChars = [datasetName UTF8String];
-        const char *identityIdChars = [[self identityId] UTF8String];
-        
-        /**
-         * Inserts a new record or replaces the current record with a given record.
-         * Increment the dirty count if we are updating the data.
-         */
-        NSString *sqlString = [NSString stringWithFormat:
-                               @"INSERT OR REPLACE INTO %@ ( \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@ \
-                               ) VALUES ( \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               COALESCE((SELECT %@ FROM %@ WHERE %@ = ? AND %@ = ? AND %@ = ?)+1, 1), \
-                               ?, \
-                               ? )",
+        result = [self putRecord_internal:record datasetName:datasetName lastModified:lastModified error:error];
+        if (result) {
+            [self cacheWrittenRecord:record datasetName:datasetName lastModified:lastModified];
+        }
+    });
 
-                               AWSCognitoDefaultSqliteDataTableName,
-                               AWSCognitoTableRecordKeyName,
-                               AWSCognitoLastModifiedFieldName,
-                               AWSCognitoModifiedByFieldName,
-                               AWSCognitoRecordValueName,
-                               AWSCognitoTypeFieldName,
-                               AWSCognitoSyncCountFieldName,
-                               AWSCognitoDirtyFieldName,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoTableDatasetKeyName,
-                               
-                               AWSCognitoDirtyFieldName,
-                               AWSCognitoDefaultSqliteDataTableName,
-                               AWSCognitoTableRecordKeyName,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoTableDatasetKeyName
-                            ];
+    return result;
+}
 
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK) {
-            sqlite3_bind_text(statement, 1, recordID, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(statement, 2, lastModified);
-            sqlite3_bind_text(statement, 3, lastModifiedBy, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 4, data, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(statement, 5, record.data.type);
-            sqlite3_bind_int64(statement, 6, record.syncCount);
-            
-            sqlite3_bind_text(statement, 7, recordID, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 8, identityIdChars, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 9, datasetNameChars, -1, SQLITE_TRANSIENT);
+- (BOOL)putRecords:(NSArray *)records datasetName:(NSString *)datasetName error:(NSError **)error {
+    __block BOOL result = YES;
 
-            sqlite3_bind_text(statement, 10, identityIdChars, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 11, datasetNameChars, -1, SQLITE_TRANSIENT);
+    dispatch_sync(self.dispatchQueue, ^{
+        // one transaction, so the whole batch costs a single sync to disk
+        sqlite3_exec(self.sqlite, "BEGIN EXCLUSIVE TRANSACTION", 0, 0, 0);
 
-            if(SQLITE_DONE == sqlite3_step(statement)) {
-                result = YES;
+        int64_t lastModified = [AWSCognitoUtil getTimeMillisForDate:[NSDate date]];
+        for (AWSCognitoRecord *record in records) {
+            if (![self putRecord_internal:record datasetName:datasetName lastModified:lastModified error:error]) {
+                result = NO;
+                break;
             }
-            else {
-                AWSLogInfo(@"Error while inserting data: %s", sqlite3_errmsg(self.sqlite));
-                if(error != nil) {
+        }
+
+        if(result){
+            if(sqlite3_exec(self.sqlite, "COMMIT TRANSACTION",0,0,0)!=SQLITE_OK){
+                AWSLogInfo(@"Error commiting records: %s", sqlite3_errmsg(self.sqlite));
+                if(error != nil)
+                {
                     *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
                 }
+                result = NO;
+            }
+        }else if(sqlite3_exec(self.sqlite, "ROLLBACK TRANSACTION",0,0,0)!=SQLITE_OK){
+            AWSLogInfo(@"Error rolling back records: %s", sqlite3_errmsg(self.sqlite));
+            //leave error message as is, don't overwrite it with the rollback error.
+        }
+
+        for (AWSCognitoRecord *record in records) {
+            if (result) {
+                [self cacheWrittenRecord:record datasetName:datasetName lastModified:lastModified];
+            } else if (record.recordId != nil) {
+                [self invalidateCachedRecords:@[record.recordId] datasetName:datasetName];
             }
         }
+    });
+
+    return result;
+}
+
+/**
+ * Writes a local change to a record. Must be called on the dispatch queue.
+ **/
+- (BOOL)putRecord_internal:(AWSCognitoRecord *)record datasetName:(NSString *)datasetName lastModified:(int64_t)lastModified error:(NSError **)error {
+    BOOL result = NO;
+
+    const char *recordID = [record.recordId UTF8String];
+    const char *lastModifiedBy = [self.deviceId UTF8String];
+    const char *datasetNameChars = [datasetName UTF8String];
+    const char *identityIdChars = [[self identityId] UTF8String];
+
+    sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementPutRecord];
+    if(statement != NULL) {
+        sqlite3_bind_text(statement, 1, recordID, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(statement, 2, lastModified);
+        sqlite3_bind_text(statement, 3, lastModifiedBy, -1, SQLITE_TRANSIENT);
+        [self bindRecordValue:record.data statement:statement index:4];
+        sqlite3_bind_int64(statement, 5, record.data.type);
+        sqlite3_bind_int64(statement, 6, record.syncCount);
+
+        sqlite3_bind_text(statement, 7, recordID, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(statement, 8, identityIdChars, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(statement, 9, datasetNameChars, -1, SQLITE_TRANSIENT);
+
+        sqlite3_bind_text(statement, 10, identityIdChars, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(statement, 11, datasetNameChars, -1, SQLITE_TRANSIENT);
+
+        if(SQLITE_DONE == sqlite3_step(statement)) {
+            result = YES;
+        }
         else {
-            AWSLogInfo(@"Error creating insert statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error while inserting data: %s", sqlite3_errmsg(self.sqlite));
             if(error != nil) {
                 *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
             }
         }
+    }
+    else {
+        AWSLogInfo(@"Error creating insert statement: %s", sqlite3_errmsg(self.sqlite));
+        if(error != nil) {
+            *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+        }
+    }
 
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
-    });
-
+    [self resetStatement:statement];
     return result;
 }
 
 - (BOOL)conditionallyPutRecord:(AWSCognitoRecord *)record datasetName:(NSString*)datasetName withCurrentState:(AWSCognitoRecord *)currentState error:(NSError **)error {
-    sqlite3_stmt *statement;
+    return [self conditionallyPutRecordId:record.recordId
+                                   string:record.data.string
+                                     type:record.data.type
+                                syncCount:record.syncCount
+                               dirtyCount:record.dirtyCount
+                             lastModified:record.lastModified
+                           lastModifiedBy:record.lastModifiedBy
+                              datasetName:datasetName
+                         withCurrentState:currentState
+                                    error:error];
+}
+
+/**
+ * Writes a record given by its fields, so remote records can be written without being
+ * converted to AWSCognitoRecord first.
+ **/
+- (BOOL)conditionallyPutRecordId:(NSString *)recordId string:(NSString *)string type:(AWSCognitoRecordValueType)type syncCount:(int64_t)syncCount dirtyCount:(int64_t)dirtyCount lastModified:(NSDate *)lastModifiedDate lastModifiedBy:(NSString *)lastModifiedBy datasetName:(NSString*)datasetName withCurrentState:(AWSCognitoRecord *)currentState error:(NSError **)error {
+    sqlite3_stmt *statement = NULL;
     
-    const char *recordID = [record.recordId UTF8String];
+    const char *recordID = [recordId UTF8String];
     
-    int64_t lastModified = [AWSCognitoUtil getTimeMillisForDate:record.lastModified];
-    const char *modifiedBy = [record.lastModifiedBy UTF8String];
-    const char *data = [[record.data toJsonString] UTF8String];
+    int64_t lastModified = [AWSCognitoUtil getTimeMillisForDate:lastModifiedDate];
+    const char *modifiedBy = [lastModifiedBy UTF8String];
     const char *datasetNameChars = [datasetName UTF8String];
     const char *identityIdChars = [[self identityId] UTF8String];
     
     if(currentState) { // Updates the local data with the new data from the remote.
         int64_t currentLastModified = [AWSCognitoUtil getTimeMillisForDate:currentState.lastModified];
         const char *currentModifiedBy = [currentState.lastModifiedBy UTF8String];
-        const char *currentData = [[currentState.data toJsonString] UTF8String];
-        
-        NSString *sqlString = [NSString stringWithFormat:
-                               @"UPDATE %@ SET \
-                               %@ = ?, \
-                               %@ = ?, \
-                               %@ = ?, \
-                               %@ = ?, \
-                               %@ = ?, \
-                               %@ = ? \
-                               WHERE %@ = ? \
-                               AND %@ = ? \
-                               AND %@ = ? \
-                               AND %@ = ? \
-                               AND %@ = ? \
-                               AND %@ = ? \
-                               AND %@ = ? \
-                               AND %@ = ? \
-                               ",
-                               
-                               AWSCognitoDefaultSqliteDataTableName,
-                               AWSCognitoLastModifiedFieldName,
-                               AWSCognitoModifiedByFieldName,
-                               AWSCognitoRecordValueName,
-                               AWSCognitoTypeFieldName,
-                               AWSCognitoSyncCountFieldName,
-                               AWSCognitoDirtyFieldName,
-                               
-                               AWSCognitoTableRecordKeyName,
-                               AWSCognitoLastModifiedFieldName,
-                               AWSCognitoModifiedByFieldName,
-                               AWSCognitoRecordValueName,
-                               AWSCognitoSyncCountFieldName,
-                               AWSCognitoDirtyFieldName,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoTableDatasetKeyName];
         
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK) {
+        statement = [self statement:AWSCognitoSQLiteStatementConditionalUpdateRecord];
+        if(statement != NULL) {
             sqlite3_bind_int64(statement, 1, lastModified);
             
             sqlite3_bind_text(statement, 2, modifiedBy, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 3, data, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(statement, 4, record.data.type);
-            sqlite3_bind_int64(statement, 5, record.syncCount);
-            sqlite3_bind_int64(statement, 6, record.dirtyCount);
+            [self bindRecordString:string type:type statement:statement index:3];
+            sqlite3_bind_int64(statement, 4, type);
+            sqlite3_bind_int64(statement, 5, syncCount);
+            sqlite3_bind_int64(statement, 6, dirtyCount);
             
             sqlite3_bind_text(statement, 7, recordID, -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(statement, 8, currentLastModified);
             sqlite3_bind_text(statement, 9, currentModifiedBy, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 10, currentData, -1, SQLITE_TRANSIENT);
+            [self bindRecordValue:currentState.data statement:statement index:10];
             sqlite3_bind_int64(statement, 11, currentState.syncCount);
             sqlite3_bind_int64(statement, 12, currentState.dirtyCount);
             sqlite3_bind_text(statement, 13, identityIdChars, -1, SQLITE_TRANSIENT);
@@ -777,48 +1993,14 @@
         }
     }
     else { // Inserts the new data from the remote.
-        NSString *sqlString = [NSString stringWithFormat:
-                               @"INSERT INTO %@ ( \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@, \
-                               %@ \
-                               ) VALUES ( \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ?, \
-                               ? \
-                               )",
-                               
-                               AWSCognitoDefaultSqliteDataTableName,
-                               
-                               AWSCognitoTableRecordKeyName,
-                               AWSCognitoLastModifiedFieldName,
-                               AWSCognitoModifiedByFieldName,
-                               AWSCognitoRecordValueName,
-                               AWSCognitoTypeFieldName,
-                               AWSCognitoSyncCountFieldName,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoTableDatasetKeyName,
-                               AWSCognitoDirtyFieldName];
-        
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK) {
+        statement = [self statement:AWSCognitoSQLiteStatementConditionalInsertRecord];
+        if(statement != NULL) {
             sqlite3_bind_text(statement, 1, recordID, -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(statement, 2, lastModified);
             sqlite3_bind_text(statement, 3, modifiedBy, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 4, data, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(statement, 5, record.data.type);
-            sqlite3_bind_int64(statement, 6, record.syncCount);
+            [self bindRecordString:string type:type statement:statement index:4];
+            sqlite3_bind_int64(statement, 5, type);
+            sqlite3_bind_int64(statement, 6, syncCount);
             sqlite3_bind_text(statement, 7, identityIdChars, -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 8, datasetNameChars, -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(statement, 9, 0);
@@ -847,50 +2029,16 @@
     return YES;
 }
 
-/**
- * Resets and finalizes a statement
- **/
-- (void)resetStatement:(sqlite3_stmt *) statement {
-    sqlite3_reset(statement);
-    sqlite3_finalize(statement);
-}
-
 - (BOOL)conditionallyPutResolvedRecords:(NSArray *) resolvedRecords datasetName:(NSString*)datasetName error:(NSError **)error {
-    sqlite3_stmt *statement = nil;
-    NSString *sqlString = [NSString stringWithFormat:
-                           @"UPDATE %@ SET \
-                           %@ = ?, \
-                           %@ = ?, \
-                           %@ = ?, \
-                           %@ = ?, \
-                           %@ = ?, \
-                           %@ = ? \
-                           WHERE %@ = ? \
-                           AND %@ = ? \
-                           AND %@ = ? \
-                           AND %@ = ? \
-                           AND %@ = ? \
-                           AND %@ = ? \
-                           AND %@ = ? \
-                           AND %@ = ? \
-                           ",
-                           
-                           AWSCognitoDefaultSqliteDataTableName,
-                           AWSCognitoLastModifiedFieldName,
-                           AWSCognitoModifiedByFieldName,
-                           AWSCognitoRecordValueName,
-                           AWSCognitoTypeFieldName,
-                           AWSCognitoSyncCountFieldName,
-                           AWSCognitoDirtyFieldName,
-                           
-                           AWSCognitoTableRecordKeyName,
-                           AWSCognitoLastModifiedFieldName,
-                           AWSCognitoModifiedByFieldName,
-                           AWSCognitoRecordValueName,
-                           AWSCognitoSyncCountFieldName,
-                           AWSCognitoDirtyFieldName,
-                           AWSCognitoTableIdentityKeyName,
-                           AWSCognitoTableDatasetKeyName];
+    sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementConditionalUpdateRecord];
+    if(statement == NULL) {
+        AWSLogInfo(@"Error creating update statement: %s", sqlite3_errmsg(self.sqlite));
+        if(error != nil)
+        {
+            *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+        }
+        return NO;
+    }
     
     for(AWSCognitoResolvedConflict *resolved in resolvedRecords){
         AWSCognitoRecord * currentState = resolved.conflict.localRecord;
@@ -899,48 +2047,42 @@
         
         int64_t lastModified = [AWSCognitoUtil getTimeMillisForDate:record.lastModified];
         const char *modifiedBy = [record.lastModifiedBy UTF8String];
-        const char *data = [[record.data toJsonString] UTF8String];
         const char *datasetNameChars = [datasetName UTF8String];
         const char *identityIdChars = [[self identityId] UTF8String];
         
         
         int64_t currentLastModified = [AWSCognitoUtil getTimeMillisForDate:currentState.lastModified];
         const char *currentModifiedBy = [currentState.lastModifiedBy UTF8String];
-        const char *currentData = [[currentState.data toJsonString] UTF8String];
         
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK)
-        {
-            sqlite3_bind_int64(statement, 1, lastModified);
-            
-            sqlite3_bind_text(statement, 2, modifiedBy, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 3, data, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(statement, 4, record.data.type);
-            sqlite3_bind_int64(statement, 5, record.syncCount);
-            sqlite3_bind_int64(statement, 6, record.dirtyCount);
-            
-            sqlite3_bind_text(statement, 7, recordID, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(statement, 8, currentLastModified);
-            sqlite3_bind_text(statement, 9, currentModifiedBy, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 10, currentData, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(statement, 11, currentState.syncCount);
-            sqlite3_bind_int64(statement, 12, currentState.dirtyCount);
-            sqlite3_bind_text(statement, 13, identityIdChars, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(statement, 14, datasetNameChars, -1, SQLITE_TRANSIENT);
-            
-            if(SQLITE_DONE != sqlite3_step(statement)){
-                AWSLogInfo(@"Error while updating data: %s", sqlite3_errmsg(self.sqlite));
-                if(error != nil)
-                {
-                    *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
-                }
-                [self resetStatement:statement];
-                return NO;
+        sqlite3_bind_int64(statement, 1, lastModified);
+        
+        sqlite3_bind_text(statement, 2, modifiedBy, -1, SQLITE_TRANSIENT);
+        [self bindRecordValue:record.data statement:statement index:3];
+        sqlite3_bind_int64(statement, 4, record.data.type);
+        sqlite3_bind_int64(statement, 5, record.syncCount);
+        sqlite3_bind_int64(statement, 6, record.dirtyCount);
+        
+        sqlite3_bind_text(statement, 7, recordID, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(statement, 8, currentLastModified);
+        sqlite3_bind_text(statement, 9, currentModifiedBy, -1, SQLITE_TRANSIENT);
+        [self bindRecordValue:currentState.data statement:statement index:10];
+        sqlite3_bind_int64(statement, 11, currentState.syncCount);
+        sqlite3_bind_int64(statement, 12, currentState.dirtyCount);
+        sqlite3_bind_text(statement, 13, identityIdChars, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(statement, 14, datasetNameChars, -1, SQLITE_TRANSIENT);
+        
+        if(SQLITE_DONE != sqlite3_step(statement)){
+            AWSLogInfo(@"Error while updating data: %s", sqlite3_errmsg(self.sqlite));
+            if(error != nil)
+            {
+                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
             }
+            [self resetStatement:statement];
+            return NO;
         }
         
-        sqlite3_reset(statement);
+        [self resetStatement:statement];
     }
-    sqlite3_finalize(statement);
     return YES;
 }
 
@@ -957,36 +2099,15 @@
         const char *recordID = [recordId UTF8String];
         const char *lastModifiedBy = [self.deviceId UTF8String];
         AWSCognitoRecordValue *value = [[AWSCognitoRecordValue alloc] initWithString:AWSCognitoDeletedRecord type:AWSCognitoRecordValueTypeDeleted];
-        const char *data = [[value toJsonString] UTF8String];
         const char *datasetNameChars = [datasetName UTF8String];
         const char *identityIdChars = [[self identityId] UTF8String];
 
-        NSString *sqlString = [NSString stringWithFormat:
-                               @"UPDATE %@ SET \
-                               %@ = %lld, \
-                               %@ = ?, \
-                               %@ = ?, \
-                               %@ = ?, \
-                               %@ = ? \
-                               WHERE %@ = ? AND %@ = ? AND %@ = ?",
-                               AWSCognitoDefaultSqliteDataTableName,
-
-                               AWSCognitoDirtyFieldName,
-                               AWSCognitoNotSyncedDeletedRecordDirty,
-
-                               AWSCognitoModifiedByFieldName,
-                               AWSCognitoLastModifiedFieldName,
-                               AWSCognitoRecordValueName,
-                               AWSCognitoTypeFieldName,
-                               AWSCognitoTableRecordKeyName,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoTableDatasetKeyName];
-
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        statement = [self statement:AWSCognitoSQLiteStatementFlagRecordAsDeleted];
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, lastModifiedBy, -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(statement, 2, lastModified);
-            sqlite3_bind_text(statement, 3, data, -1, SQLITE_TRANSIENT);
+            [self bindRecordValue:value statement:statement index:3];
             sqlite3_bind_int64(statement, 4, value.type);
             sqlite3_bind_text(statement, 5, recordID, -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 6, identityIdChars, -1, SQLITE_TRANSIENT);
@@ -1014,8 +2135,10 @@
             }
         }
 
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
+        [self resetStatement:statement];
+        if (recordId != nil) {
+            [self invalidateCachedRecords:@[recordId] datasetName:datasetName];
+        }
     });
 
     return result;
@@ -1028,14 +2151,9 @@
     dispatch_sync(self.dispatchQueue, ^{
         const char *datasetNameChars = [datasetName UTF8String];
         const char *identityIdChars = [[self identityId] UTF8String];
-        
-        NSString *statementString = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ? AND %@ = ? AND %@ = ?",
-                                     AWSCognitoDefaultSqliteDataTableName,
-                                     AWSCognitoTableRecordKeyName,
-                                     AWSCognitoTableIdentityKeyName,
-                                     AWSCognitoTableDatasetKeyName];
-        sqlite3_stmt *statement;
-        if(sqlite3_prepare_v2(self.sqlite, [statementString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        
+        sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementDeleteRecord];
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, [recordId UTF8String], -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 2, identityIdChars, -1, SQLITE_TRANSIENT);
@@ -1063,27 +2181,67 @@
             }
         }
 
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
+        [self resetStatement:statement];
+        if (recordId != nil) {
+            [self invalidateCachedRecords:@[recordId] datasetName:datasetName];
+        }
     });
 
     return result;
 }
 
 - (BOOL)updateWithRemoteChanges:(NSString *)datasetName nonConflicts:(NSArray *)nonConflictRecords resolvedConflicts:(NSArray *)resolvedConflicts error:(NSError **)error {
+    NSMutableArray *recordIds = [NSMutableArray arrayWithCapacity:[nonConflictRecords count]];
+    for (AWSCognitoRecordTuple *tuple in nonConflictRecords) {
+        if (tuple.remoteRecord.recordId != nil) {
+            [recordIds addObject:tuple.remoteRecord.recordId];
+        }
+    }
+    
+    return [self writeRemoteChanges:datasetName recordIds:recordIds resolvedConflicts:resolvedConflicts error:error writes:^BOOL(NSError **writeError) {
+        // put the non-conflicts
+        for (AWSCognitoRecordTuple *tuple in nonConflictRecords) {
+            if (![self conditionallyPutRecord:tuple.remoteRecord datasetName:datasetName withCurrentState:tuple.localRecord error:writeError]) {
+                return NO;
+            }
+        }
+        return YES;
+    }];
+}
+
+- (BOOL)updateWithRemoteRecords:(NSString *)datasetName records:(NSArray *)remoteRecords localRecords:(NSDictionary *)localRecords resolvedConflicts:(NSArray *)resolvedConflicts error:(NSError **)error {
+    return [self writeRemoteChanges:datasetName recordIds:[remoteRecords valueForKey:@"key"] resolvedConflicts:resolvedConflicts error:error writes:^BOOL(NSError **writeError) {
+        for (AWSCognitoSyncRecord *record in remoteRecords) {
+            NSString *lastModifiedBy = record.lastModifiedBy ? record.lastModifiedBy : @"Unknown";
+            if (![self conditionallyPutRecordId:record.key
+                                         string:record.value
+                                           type:record.value ? AWSCognitoRecordValueTypeString : AWSCognitoRecordValueTypeDeleted
+                                      syncCount:[record.syncCount longLongValue]
+                                     dirtyCount:0
+                                   lastModified:record.lastModifiedDate
+                                 lastModifiedBy:lastModifiedBy
+                                    datasetName:datasetName
+                               withCurrentState:[localRecords objectForKey:record.key]
+                                          error:writeError]) {
+                return NO;
+            }
+        }
+        return YES;
+    }];
+}
+
+/**
+ * Runs the writes of the non-conflicting records, then writes the resolved conflicts, all in
+ * one transaction, and drops the cached copies of every record written.
+ **/
+- (BOOL)writeRemoteChanges:(NSString *)datasetName recordIds:(NSArray *)recordIds resolvedConflicts:(NSArray *)resolvedConflicts error:(NSError **)error writes:(BOOL (^)(NSError **writeError))writes {
     __block BOOL result = YES;
     dispatch_sync(self.dispatchQueue, ^{
         
         // Do this as a single transaction
         sqlite3_exec(self.sqlite, "BEGIN EXCLUSIVE TRANSACTION", 0, 0, 0);
         
-        // put the non-conflicts
-        for (AWSCognitoRecordTuple *tuple in nonConflictRecords) {
-            if (![self conditionallyPutRecord:tuple.remoteRecord datasetName:datasetName withCurrentState:tuple.localRecord error:error]) {
-                result = NO;
-                break;
-            }
-        }
+        result = writes(error);
         
         // put the conflicts if non-conflicts wrote
         if (result) {
@@ -1103,6 +2261,14 @@
             AWSLogInfo(@"Error rolling back reparent: %s", sqlite3_errmsg(self.sqlite));
             //leave error message as is, don't overwrite it with the rollback error.
         }
+        
+        NSMutableArray *writtenIds = [NSMutableArray arrayWithArray:recordIds];
+        for (AWSCognitoResolvedConflict *resolved in resolvedConflicts) {
+            if (resolved.resolvedConflict.recordId != nil) {
+                [writtenIds addObject:resolved.resolvedConflict.recordId];
+            }
+        }
+        [self invalidateCachedRecords:writtenIds datasetName:datasetName];
     });
     return result;
 }
@@ -1149,6 +2315,13 @@
             //leave error message as is, don't overwrite it with the rollback error.
         }
 
+        NSMutableArray *recordIds = [NSMutableArray arrayWithCapacity:[updatedRecords count]];
+        for (AWSCognitoRecordTuple *tuple in updatedRecords) {
+            if (tuple.remoteRecord.recordId != nil) {
+                [recordIds addObject:tuple.remoteRecord.recordId];
+            }
+        }
+        [self invalidateCachedRecords:recordIds datasetName:datasetName];
     });
     return result;
 }
@@ -1158,15 +2331,10 @@
 {
     __block int64_t numRecords = 0;
     
-    dispatch_sync(self.dispatchQueue, ^{
-        NSString *query = [NSString stringWithFormat:@"SELECT COUNT(*) FROM %@ WHERE %@=? AND %@ = ?",
-                           AWSCognitoDefaultSqliteDataTableName,
-                           AWSCognitoTableDatasetKeyName,
-                           AWSCognitoTableIdentityKeyName];
-        
-        sqlite3_stmt *statement;
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementNumRecords];
         
-        if(sqlite3_prepare_v2(self.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 2, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
@@ -1178,14 +2346,151 @@
         }
         else
         {
-            AWSLogInfo(@"Error creating num records count statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error creating num records count statement: %s", sqlite3_errmsg(connection.sqlite));
         }
         
-        sqlite3_reset(statement);
+        [self resetStatement:statement];
+    }];
+    
+    return [NSNumber numberWithLongLong:numRecords];
+}
+
+//Gets bytes used by the records stored in SQLite
+- (NSNumber *)localDataStorage:(NSString *)datasetName
+{
+    __block int64_t dataStorage = 0;
+    
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementLocalDataStorage];
+        
+        if(statement != NULL)
+        {
+            sqlite3_bind_text(statement, 1, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(statement, 2, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+            
+            if (sqlite3_step(statement)==SQLITE_ROW)
+            {
+                dataStorage = sqlite3_column_int64(statement, 0);
+            }
+        }
+        else
+        {
+            AWSLogInfo(@"Error creating local data storage statement: %s", sqlite3_errmsg(connection.sqlite));
+        }
+        
+        [self resetStatement:statement];
+    }];
+    
+    return [NSNumber numberWithLongLong:dataStorage];
+}
+
+- (BOOL)verifyLocalCounters:(NSString *)datasetName error:(NSError **)error
+{
+    __block BOOL result = NO;
+    
+    dispatch_sync(self.dispatchQueue, ^{
+        NSString *statementString = [NSString stringWithFormat:@"SELECT %@, %@, %@, %@ FROM %@ WHERE %@ = ?1 AND %@ = ?2",
+                                     AWSCognitoLocalRecordCountFieldName,
+                                     AWSCognitoLocalDataStorageFieldName,
+                                     [AWSCognitoSQLiteManager localRecordCountSQLForIdentity:@"?1" dataset:@"?2"],
+                                     [AWSCognitoSQLiteManager localDataStorageSQLForIdentity:@"?1" dataset:@"?2"],
+                                     AWSCognitoDefaultSqliteMetadataTableName,
+                                     AWSCognitoTableIdentityKeyName,
+                                     AWSCognitoTableDatasetKeyName];
+        sqlite3_stmt *statement;
+        if(sqlite3_prepare_v2(self.sqlite, [statementString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        {
+            sqlite3_bind_text(statement, 1, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(statement, 2, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
+            
+            int status = sqlite3_step(statement);
+            if (status == SQLITE_ROW)
+            {
+                int64_t recordCount = sqlite3_column_int64(statement, 0);
+                int64_t dataStorage = sqlite3_column_int64(statement, 1);
+                int64_t actualRecordCount = sqlite3_column_int64(statement, 2);
+                int64_t actualDataStorage = sqlite3_column_int64(statement, 3);
+                
+                result = (recordCount == actualRecordCount) && (dataStorage == actualDataStorage);
+                if (!result) {
+                    AWSLogError(@"Local counters for %@ are out of date: %lld records and %lld bytes recorded, %lld records and %lld bytes stored",
+                                datasetName, recordCount, dataStorage, actualRecordCount, actualDataStorage);
+                    if(error != nil)
+                    {
+                        *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"Local counters for %@ are out of date", datasetName]];
+                    }
+                }
+            }
+            else if (status == SQLITE_DONE)
+            {
+                // without metadata there is nothing to keep consistent
+                result = YES;
+            }
+            else
+            {
+                AWSLogInfo(@"Error while verifying local counters: %s", sqlite3_errmsg(self.sqlite));
+                if(error != nil)
+                {
+                    *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+                }
+            }
+        }
+        else
+        {
+            AWSLogInfo(@"Error while verifying local counters: %s", sqlite3_errmsg(self.sqlite));
+            if(error != nil)
+            {
+                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+            }
+        }
         sqlite3_finalize(statement);
     });
+    return result;
+}
+
+- (BOOL)repairLocalCounters:(NSError **)error
+{
+    __block BOOL result = NO;
     
-    return [NSNumber numberWithLongLong:numRecords];
+    dispatch_sync(self.dispatchQueue, ^{
+        NSString *identity = [NSString stringWithFormat:@"%@.%@", AWSCognitoDefaultSqliteMetadataTableName, AWSCognitoTableIdentityKeyName];
+        NSString *dataset = [NSString stringWithFormat:@"%@.%@", AWSCognitoDefaultSqliteMetadataTableName, AWSCognitoTableDatasetKeyName];
+        NSString *statementString = [NSString stringWithFormat:@"UPDATE %@ SET %@ = %@, %@ = %@ WHERE %@ = ?",
+                                     AWSCognitoDefaultSqliteMetadataTableName,
+                                     AWSCognitoLocalRecordCountFieldName,
+                                     [AWSCognitoSQLiteManager localRecordCountSQLForIdentity:identity dataset:dataset],
+                                     AWSCognitoLocalDataStorageFieldName,
+                                     [AWSCognitoSQLiteManager localDataStorageSQLForIdentity:identity dataset:dataset],
+                                     AWSCognitoTableIdentityKeyName];
+        sqlite3_stmt *statement;
+        if(sqlite3_prepare_v2(self.sqlite, [statementString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        {
+            sqlite3_bind_text(statement, 1, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+            
+            if(SQLITE_DONE != sqlite3_step(statement))
+            {
+                AWSLogInfo(@"Error while repairing local counters: %s", sqlite3_errmsg(self.sqlite));
+                if(error != nil)
+                {
+                    *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+                }
+            }
+            else
+            {
+                result = YES;
+            }
+        }
+        else
+        {
+            AWSLogInfo(@"Error while repairing local counters: %s", sqlite3_errmsg(self.sqlite));
+            if(error != nil)
+            {
+                *error = [AWSCognitoUtil errorLocalDataStorageFailed:[NSString stringWithFormat:@"%s", sqlite3_errmsg(self.sqlite)]];
+            }
+        }
+        sqlite3_finalize(statement);
+    });
+    return result;
 }
 
 #pragma mark - Sync table utilities
@@ -1195,16 +2500,10 @@
 {
     __block int64_t lastSyncCount = 0;
 
-    dispatch_sync(self.dispatchQueue, ^{
-        NSString *query = [NSString stringWithFormat:@"SELECT %@ FROM %@ WHERE %@=? AND %@ = ?",
-                           AWSCognitoLastSyncCount,
-                           AWSCognitoDefaultSqliteMetadataTableName,
-                           AWSCognitoTableDatasetKeyName,
-                           AWSCognitoTableIdentityKeyName];
-
-        sqlite3_stmt *statement;
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementLastSyncCount];
 
-        if(sqlite3_prepare_v2(self.sqlite, [query UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 2, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
@@ -1216,12 +2515,11 @@
         }
         else
         {
-            AWSLogInfo(@"Error creating query sync count statement: %s", sqlite3_errmsg(self.sqlite));
+            AWSLogInfo(@"Error creating query sync count statement: %s", sqlite3_errmsg(connection.sqlite));
         }
 
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
-    });
+        [self resetStatement:statement];
+    }];
 
     return [NSNumber numberWithLongLong:lastSyncCount];
 }
@@ -1233,15 +2531,9 @@
     }
     
     dispatch_sync(self.dispatchQueue, ^{
-        NSString *sqlString = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@(%@,%@,%@,%@) VALUES (?,?,?,?)",
-                               AWSCognitoDefaultSqliteMetadataTableName,
-                               AWSCognitoTableDatasetKeyName,
-                               AWSCognitoLastSyncCount,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoModifiedByFieldName];
-        sqlite3_stmt *statement;
+        sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementUpdateLastSyncCount];
 
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(statement, 2, [syncCount longLongValue]);
@@ -1258,11 +2550,173 @@
         {
             AWSLogInfo(@"Error updating sync count: %s", sqlite3_errmsg(self.sqlite));
         }
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
+        [self resetStatement:statement];
+    });
+}
+
+- (NSNumber *)remoteLastModified:(NSString *)datasetName pulled:(BOOL *)pulled
+{
+    __block int64_t lastModified = 0;
+    __block BOOL isPulled = NO;
+    
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementPullState];
+        
+        if(statement != NULL)
+        {
+            sqlite3_bind_text(statement, 1, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(statement, 2, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
+            
+            if (sqlite3_step(statement) == SQLITE_ROW)
+            {
+                lastModified = sqlite3_column_int64(statement, 0);
+                isPulled = sqlite3_column_int(statement, 1) != 0;
+            }
+        }
+        else
+        {
+            AWSLogInfo(@"Error creating pull state statement: %s", sqlite3_errmsg(connection.sqlite));
+        }
+        
+        [self resetStatement:statement];
+    }];
+    
+    if (pulled != NULL) {
+        *pulled = isPulled && lastModified != 0;
+    }
+    return [NSNumber numberWithLongLong:lastModified];
+}
+
+- (void)updatePulledLastModified:(NSString *)datasetName lastModified:(NSNumber *)lastModified
+{
+    dispatch_sync(self.dispatchQueue, ^{
+        sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementUpdatePulledLastModified];
+        
+        if(statement != NULL)
+        {
+            sqlite3_bind_int64(statement, 1, [lastModified longLongValue]);
+            sqlite3_bind_text(statement, 2, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(statement, 3, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
+            
+            if(SQLITE_DONE != sqlite3_step(statement))
+            {
+                AWSLogInfo(@"Error while updating pull state: %s", sqlite3_errmsg(self.sqlite));
+            }
+        }
+        else
+        {
+            AWSLogInfo(@"Error creating pull state statement: %s", sqlite3_errmsg(self.sqlite));
+        }
+        [self resetStatement:statement];
+    });
+}
+
+- (BOOL)syncCheckpoint:(NSString *)datasetName syncCount:(NSNumber **)syncCount sessionToken:(NSString **)sessionToken nextToken:(NSString **)nextToken appliedSyncCount:(NSNumber **)appliedSyncCount
+{
+    __block BOOL result = NO;
+    
+    [self performRead:^(AWSCognitoSQLiteConnection *connection) {
+        sqlite3_stmt *statement = [connection statement:AWSCognitoSQLiteStatementSyncCheckpoint];
+        
+        if(statement != NULL)
+        {
+            sqlite3_bind_text(statement, 1, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(statement, 2, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
+            
+            if (sqlite3_step(statement) == SQLITE_ROW)
+            {
+                result = YES;
+                if (syncCount != NULL) {
+                    *syncCount = [NSNumber numberWithLongLong:sqlite3_column_int64(statement, 0)];
+                }
+                if (sessionToken != NULL) {
+                    const char *token = (const char *)sqlite3_column_text(statement, 1);
+                    *sessionToken = token ? [NSString stringWithUTF8String:token] : nil;
+                }
+                if (nextToken != NULL) {
+                    *nextToken = [NSString stringWithUTF8String:(const char *)sqlite3_column_text(statement, 2)];
+                }
+                if (appliedSyncCount != NULL) {
+                    *appliedSyncCount = [NSNumber numberWithLongLong:sqlite3_column_int64(statement, 3)];
+                }
+            }
+        }
+        else
+        {
+            AWSLogInfo(@"Error creating sync checkpoint statement: %s", sqlite3_errmsg(connection.sqlite));
+        }
+        
+        [self resetStatement:statement];
+    }];
+    
+    return result;
+}
+
+- (void)updateSyncCheckpoint:(NSString *)datasetName syncCount:(NSNumber *)syncCount sessionToken:(NSString *)sessionToken nextToken:(NSString *)nextToken appliedSyncCount:(NSNumber *)appliedSyncCount
+{
+    dispatch_sync(self.dispatchQueue, ^{
+        sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementUpdateSyncCheckpoint];
+        
+        if(statement != NULL)
+        {
+            // without a next page the checkpoint columns stay unbound, which sets them to NULL
+            if (nextToken != nil) {
+                sqlite3_bind_int64(statement, 1, [syncCount longLongValue]);
+                sqlite3_bind_text(statement, 2, [sessionToken UTF8String], -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(statement, 3, [nextToken UTF8String], -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int64(statement, 4, [appliedSyncCount longLongValue]);
+            }
+            sqlite3_bind_text(statement, 5, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(statement, 6, [datasetName UTF8String], -1, SQLITE_TRANSIENT);
+            
+            if(SQLITE_DONE != sqlite3_step(statement))
+            {
+                AWSLogInfo(@"Error while updating sync checkpoint: %s", sqlite3_errmsg(self.sqlite));
+            }
+        }
+        else
+        {
+            AWSLogInfo(@"Error creating sync checkpoint statement: %s", sqlite3_errmsg(self.sqlite));
+        }
+        [self resetStatement:statement];
     });
 }
 
+/**
+ * Forgets which remote state was pulled for every dataset of the current identity that is not
+ * in the given list. Must be called on the dispatch queue.
+ **/
+- (void)clearPulledLastModifiedExcept:(NSArray *)datasetNames {
+    NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:[datasetNames count]];
+    for (NSUInteger i = 0; i < [datasetNames count]; i++) {
+        [placeholders addObject:@"?"];
+    }
+    NSString *updateString = [NSString stringWithFormat:@"UPDATE %@ SET %@ = NULL WHERE %@ = ? AND %@ NOT IN (%@)",
+                              AWSCognitoDefaultSqliteMetadataTableName,
+                              AWSCognitoPulledLastModifiedFieldName,
+                              AWSCognitoTableIdentityKeyName,
+                              AWSCognitoTableDatasetKeyName,
+                              [placeholders componentsJoinedByString:@","]];
+    
+    sqlite3_stmt *statement = NULL;
+    if(sqlite3_prepare_v2(self.sqlite, [updateString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+    {
+        sqlite3_bind_text(statement, 1, [[self identityId] UTF8String], -1, SQLITE_TRANSIENT);
+        for (NSUInteger i = 0; i < [datasetNames count]; i++) {
+            sqlite3_bind_text(statement, (int)i + 2, [datasetNames[i] UTF8String], -1, SQLITE_TRANSIENT);
+        }
+        if(SQLITE_DONE != sqlite3_step(statement))
+        {
+            AWSLogInfo(@"Error while clearing pull state: %s", sqlite3_errmsg(self.sqlite));
+        }
+    }
+    else
+    {
+        AWSLogInfo(@"Error creating pull state statement: %s", sqlite3_errmsg(self.sqlite));
+    }
+    sqlite3_finalize(statement);
+}
+
 
 
 #pragma mark - Merge Utilties
@@ -1389,7 +2843,9 @@
             AWSLogInfo(@"Error rolling back reparent: %s", sqlite3_errmsg(self.sqlite));
             //leave error message as is, don't overwrite it with the rollback error.
         }
-    
+        
+        // datasets move between identities and get renamed
+        [self.recordCache removeAllObjects];
     });
     
     return result;
@@ -1550,7 +3006,7 @@
             AWSLogInfo(@"Error rolling back reset: %s", sqlite3_errmsg(self.sqlite));
             //leave error message as is, don't overwrite it with the rollback error.
         }
-        
+        [self invalidateCachedDataset:datasetName];
     });
     
     return result;
@@ -1603,13 +3059,12 @@
 
     dispatch_sync(self.dispatchQueue, ^{
         
-        NSString *statementString = [NSString stringWithFormat:@"DELETE FROM %@ WHERE %@ = ? AND %@ = ?", AWSCognitoDefaultSqliteDataTableName, AWSCognitoTableIdentityKeyName, AWSCognitoTableDatasetKeyName];
-        sqlite3_stmt *statement;
+        sqlite3_stmt *statement = [self statement:AWSCognitoSQLiteStatementDeleteDatasetRecords];
         
         const char *datasetNameChars = [datasetName UTF8String];
         const char *identityIdChars = [[self identityId] UTF8String];
        
-        if(sqlite3_prepare_v2(self.sqlite, [statementString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, identityIdChars, -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(statement, 2, datasetNameChars, -1, SQLITE_TRANSIENT);
@@ -1633,17 +3088,10 @@
             }
 
         }
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
+        [self resetStatement:statement];
 
-        NSString *sqlString = [NSString stringWithFormat:@"INSERT OR REPLACE INTO %@(%@,%@,%@,%@) VALUES (?,?,?,?)",
-                               AWSCognitoDefaultSqliteMetadataTableName,
-                               AWSCognitoTableDatasetKeyName,
-                               AWSCognitoLastSyncCount,
-                               AWSCognitoTableIdentityKeyName,
-                               AWSCognitoModifiedByFieldName];
-        
-        if(sqlite3_prepare_v2(self.sqlite, [sqlString UTF8String], -1, &statement, NULL) == SQLITE_OK)
+        statement = [self statement:AWSCognitoSQLiteStatementUpdateLastSyncCount];
+        if(statement != NULL)
         {
             sqlite3_bind_text(statement, 1, datasetNameChars, -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(statement, 2, -1);
@@ -1661,9 +3109,8 @@
         {
             AWSLogInfo(@"Error updating sync count: %s", sqlite3_errmsg(self.sqlite));
         }
-        sqlite3_reset(statement);
-        sqlite3_finalize(statement);
-
+        [self resetStatement:statement];
+        [self invalidateCachedDataset:datasetName];
     });
     return result;
 }
@@ -1688,13 +3135,22 @@
 
 - (void)deleteSQLiteDatabase
 {
+    [self closeReadConnections];
+
     dispatch_sync(self.dispatchQueue, ^{
-        if([[NSFileManager defaultManager] fileExistsAtPath:[self filePath]])
-        {
-            NSError *error;
-            [[NSFileManager defaultManager] removeItemAtPath:[self filePath] error:&error];
-            if (error) {
-                AWSLogDebug(@"Error deleting DB file %@", error);
+        [self.writeConnection finalizeStatements];
+        [self.recordCache removeAllObjects];
+
+        // also remove the write-ahead log and its index if concurrent reads were ever enabled
+        NSString *filePath = [self filePath];
+        for (NSString *path in @[filePath, [filePath stringByAppendingString:@"-wal"], [filePath stringByAppendingString:@"-shm"]]) {
+            if([[NSFileManager defaultManager] fileExistsAtPath:path])
+            {
+                NSError *error;
+                [[NSFileManager defaultManager] removeItemAtPath:path error:&error];
+                if (error) {
+                    AWSLogDebug(@"Error deleting DB file %@", error);
+                }
             }
         }
     });
@@ -19,6 +19,117 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class AWSCognitoSync;
+
+/**
+ Timings, sizes and outcome of one call to an `AWSCognitoSync` operation, across all of its attempts.
+ */
+@interface AWSCognitoSyncMetrics : NSObject
+
+/**
+ The name of the operation, e.g. `ListRecords`.
+ */
+@property (nonatomic, strong, readonly) NSString *operationName;
+
+/**
+ Seconds spent turning the request into an HTTP body, summed over attempts.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval serializeDuration;
+
+/**
+ Seconds between serializing and deserializing, including signing, credential refreshes, the transfer and any waits between retries.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval networkDuration;
+
+/**
+ Seconds spent turning responses into the result or error, summed over attempts.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval deserializeDuration;
+
+/**
+ Seconds from the call until its task finished.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval totalDuration;
+
+/**
+ Size of the last request body before any compression, and of the last response body, in bytes.
+ */
+@property (nonatomic, assign, readonly) NSUInteger requestBytes;
+@property (nonatomic, assign, readonly) NSUInteger responseBytes;
+
+/**
+ The number of attempts after the first one.
+ */
+@property (nonatomic, assign, readonly) uint32_t retries;
+
+/**
+ The HTTP status code of the last response, or 0 if none was received.
+ */
+@property (nonatomic, assign, readonly) NSInteger statusCode;
+
+/**
+ The error the call failed with, or `nil` if it succeeded.
+ */
+@property (nonatomic, strong, readonly, nullable) NSError *error;
+
+@end
+
+/**
+ Receives the metrics of every call made by an `AWSCognitoSync` client it is set on.
+ */
+@protocol AWSCognitoSyncMetricsDelegate <NSObject>
+
+/**
+ Called once per call when its task finishes, on the thread that finished it.
+ */
+- (void)cognitoSync:(AWSCognitoSync *)cognitoSync didFinishCallWithMetrics:(AWSCognitoSyncMetrics *)metrics;
+
+@end
+
+/**
+ Aggregated metrics of the calls made to one operation.
+ */
+@interface AWSCognitoSyncOperationStatistics : NSObject
+
+@property (nonatomic, assign, readonly) NSUInteger calls;
+@property (nonatomic, assign, readonly) NSUInteger retries;
+@property (nonatomic, assign, readonly) unsigned long long requestBytes;
+@property (nonatomic, assign, readonly) unsigned long long responseBytes;
+
+/**
+ The number of failed calls by error domain and code, keyed as `domain:code`.
+ */
+@property (nonatomic, strong, readonly) NSDictionary<NSString *, NSNumber *> *errorCounts;
+
+/**
+ Call counts by total duration. Bucket i holds calls that took less than 2^i milliseconds and at least half that, the last bucket holds every slower call.
+ */
+@property (nonatomic, strong, readonly) NSArray<NSNumber *> *durationHistogram;
+
+/**
+ The upper bound, in seconds, of the histogram bucket holding the given percentile of calls, e.g. 0.99. For the last bucket this is its lower bound. Returns 0 if there were no calls.
+ */
+- (NSTimeInterval)durationPercentile:(double)percentile;
+
+@end
+
+/**
+ A metrics delegate that keeps per operation statistics in memory.
+ */
+@interface AWSCognitoSyncMetricsCollector : NSObject <AWSCognitoSyncMetricsDelegate>
+
+/**
+ A snapshot of the statistics collected so far for the operation, or `nil` if it wasn't called.
+ */
+- (nullable AWSCognitoSyncOperationStatistics *)statisticsForOperation:(NSString *)operationName;
+
+/**
+ Forgets all collected statistics.
+ */
+- (void)reset;
+
+@end
+
 /**
  <fullname>Amazon Cognito Sync</fullname><p>Amazon Cognito Sync provides an AWS service and client library that enable cross-device syncing of application-related user data. High-level client libraries are available for both iOS and Android. You can use these libraries to persist data locally so that it's available even if the device is offline. Developer credentials don't need to be stored on the mobile device to access the service. You can use Amazon Cognito to obtain a normalized user ID and credentials. User data is persisted in a dataset that can store up to 1 MB of key-value pairs, and you can have up to 20 datasets per user identity.</p><p>With Amazon Cognito Sync, the data stored for each identity is accessible only to credentials assigned to that identity. In order to use the Cognito Sync service, you need to make API calls using credentials retrieved with <a href="http://docs.aws.amazon.com/cognitoidentity/latest/APIReference/Welcome.html">Amazon Cognito Identity service</a>.</p><p>If you want to use Cognito Sync in an Android or iOS application, you will probably want to make API calls via the AWS Mobile SDK. To learn more, see the <a href="http://docs.aws.amazon.com/mobile/sdkforandroid/developerguide/cognito-sync.html">Developer Guide for Android</a> and the <a href="http://docs.aws.amazon.com/mobile/sdkforios/developerguide/cognito-sync.html">Developer Guide for iOS</a>.</p>
  */
@@ -31,6 +142,16 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, strong, readonly) AWSServiceConfiguration *configuration;
 
+/**
+ Request bodies of at least this many bytes are sent gzip compressed with `Content-Encoding: gzip`. Only enable this against an endpoint that accepts compressed requests. The default of 0 sends every body uncompressed. Responses are decompressed by the URL loading system whenever the service compresses them.
+ */
+@property (nonatomic, assign) NSUInteger requestCompressionThreshold;
+
+/**
+ Receives the metrics of every call this client makes. Collecting them builds serializers for each call, so leave it `nil` unless the metrics are used. See `AWSCognitoSyncMetricsCollector`.
+ */
+@property (nonatomic, weak, nullable) id<AWSCognitoSyncMetricsDelegate> metricsDelegate;
+
 /**
  Returns the singleton service client. If the singleton object does not exist, the SDK instantiates the default service client with `defaultServiceConfiguration` from `[AWSServiceManager defaultServiceManager]`. The reference to this object is maintained by the SDK, and you do not need to retain it manually.
 
@@ -24,9 +24,76 @@
 #import <AWSCore/AWSURLRequestRetryHandler.h>
 #import <AWSCore/AWSSynchronizedMutableDictionary.h>
 #import "AWSCognitoSyncResources.h"
+#import <zlib.h>
+
+@interface AWSCognitoSyncMetrics()
+
+@property (nonatomic, strong) NSString *operationName;
+@property (nonatomic, assign) NSTimeInterval serializeDuration;
+@property (nonatomic, assign) NSTimeInterval networkDuration;
+@property (nonatomic, assign) NSTimeInterval deserializeDuration;
+@property (nonatomic, assign) NSTimeInterval totalDuration;
+@property (nonatomic, assign) NSUInteger requestBytes;
+@property (nonatomic, assign) NSUInteger responseBytes;
+@property (nonatomic, assign) uint32_t retries;
+@property (nonatomic, assign) NSInteger statusCode;
+@property (nonatomic, strong) NSError *error;
+// attempts seen by each serializer; attempts failing before a response only reach the request serializer
+@property (nonatomic, assign) uint32_t serializedAttempts;
+@property (nonatomic, assign) uint32_t deserializedAttempts;
+
+@end
+
+@implementation AWSCognitoSyncMetrics
+
+- (instancetype)initWithOperationName:(NSString *)operationName {
+    if (self = [super init]) {
+        _operationName = operationName;
+    }
+    return self;
+}
+
+- (void)finishWithError:(NSError *)error totalDuration:(NSTimeInterval)totalDuration {
+    self.error = error;
+    self.totalDuration = totalDuration;
+    self.networkDuration = MAX(0, totalDuration - self.serializeDuration - self.deserializeDuration);
+    uint32_t attempts = MAX(self.serializedAttempts, self.deserializedAttempts);
+    self.retries = attempts > 0 ? attempts - 1 : 0;
+}
+
+@end
+
+@interface AWSCognitoSyncRequestSerializer : AWSJSONRequestSerializer
+
+@property (nonatomic, strong) AWSCognitoSyncMetrics *metrics;
+
+@end
+
+@implementation AWSCognitoSyncRequestSerializer
+
+- (AWSTask *)serializeRequest:(NSMutableURLRequest *)request
+                     headers:(NSDictionary *)headers
+                  parameters:(NSDictionary *)parameters {
+    AWSCognitoSyncMetrics *metrics = self.metrics;
+    if (!metrics) {
+        return [super serializeRequest:request headers:headers parameters:parameters];
+    }
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    return [[super serializeRequest:request headers:headers parameters:parameters] continueWithBlock:^id(AWSTask *task) {
+        metrics.serializeDuration += CFAbsoluteTimeGetCurrent() - start;
+        metrics.serializedAttempts++;
+        metrics.requestBytes = [request.HTTPBody length];
+        return task;
+    }];
+}
+
+@end
 
 @interface AWSCognitoSyncResponseSerializer : AWSJSONResponseSerializer
 
+@property (nonatomic, strong) AWSCognitoSyncMetrics *metrics;
+
 @end
 
 @implementation AWSCognitoSyncResponseSerializer
@@ -54,11 +121,94 @@ static NSDictionary *errorCodeDictionary = nil;
                             };
 }
 
+#pragma mark - Record pages
+
+// ListRecords and UpdateRecords responses carry up to a dataset's worth of records, so they are
+// mapped field by field here instead of through the reflective AWSMTLJSONAdapter pass
+
+static NSString *AWSCognitoSyncJSONString(id value) {
+    return [value isKindOfClass:[NSString class]] ? value : nil;
+}
+
+static NSNumber *AWSCognitoSyncJSONNumber(id value) {
+    return [value isKindOfClass:[NSNumber class]] ? value : nil;
+}
+
+static NSDate *AWSCognitoSyncJSONDate(id value) {
+    if ([value isKindOfClass:[NSNumber class]] || [value isKindOfClass:[NSString class]]) {
+        return [NSDate dateWithTimeIntervalSince1970:[value doubleValue]];
+    }
+    return [value isKindOfClass:[NSDate class]] ? value : nil;
+}
+
+static NSArray *AWSCognitoSyncJSONRecords(id value) {
+    if (![value isKindOfClass:[NSArray class]]) {
+        return nil;
+    }
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:[value count]];
+    for (NSDictionary *JSONRecord in value) {
+        if (![JSONRecord isKindOfClass:[NSDictionary class]]) {
+            continue;
+        }
+        AWSCognitoSyncRecord *record = [AWSCognitoSyncRecord new];
+        record.deviceLastModifiedDate = AWSCognitoSyncJSONDate(JSONRecord[@"DeviceLastModifiedDate"]);
+        record.key = AWSCognitoSyncJSONString(JSONRecord[@"Key"]);
+        record.lastModifiedBy = AWSCognitoSyncJSONString(JSONRecord[@"LastModifiedBy"]);
+        record.lastModifiedDate = AWSCognitoSyncJSONDate(JSONRecord[@"LastModifiedDate"]);
+        record.syncCount = AWSCognitoSyncJSONNumber(JSONRecord[@"SyncCount"]);
+        record.value = AWSCognitoSyncJSONString(JSONRecord[@"Value"]);
+        [records addObject:record];
+    }
+    return records;
+}
+
+- (id)recordPageForJSONDictionary:(NSDictionary *)JSONDictionary {
+    if (self.outputClass == [AWSCognitoSyncListRecordsResponse class]) {
+        AWSCognitoSyncListRecordsResponse *page = [AWSCognitoSyncListRecordsResponse new];
+        page.count = AWSCognitoSyncJSONNumber(JSONDictionary[@"Count"]);
+        page.datasetDeletedAfterRequestedSyncCount = AWSCognitoSyncJSONNumber(JSONDictionary[@"DatasetDeletedAfterRequestedSyncCount"]);
+        page.datasetExists = AWSCognitoSyncJSONNumber(JSONDictionary[@"DatasetExists"]);
+        page.datasetSyncCount = AWSCognitoSyncJSONNumber(JSONDictionary[@"DatasetSyncCount"]);
+        page.lastModifiedBy = AWSCognitoSyncJSONString(JSONDictionary[@"LastModifiedBy"]);
+        id mergedDatasetNames = JSONDictionary[@"MergedDatasetNames"];
+        page.mergedDatasetNames = [mergedDatasetNames isKindOfClass:[NSArray class]] ? mergedDatasetNames : nil;
+        page.nextToken = AWSCognitoSyncJSONString(JSONDictionary[@"NextToken"]);
+        page.records = AWSCognitoSyncJSONRecords(JSONDictionary[@"Records"]);
+        page.syncSessionToken = AWSCognitoSyncJSONString(JSONDictionary[@"SyncSessionToken"]);
+        return page;
+    }
+    if (self.outputClass == [AWSCognitoSyncUpdateRecordsResponse class]) {
+        AWSCognitoSyncUpdateRecordsResponse *page = [AWSCognitoSyncUpdateRecordsResponse new];
+        page.records = AWSCognitoSyncJSONRecords(JSONDictionary[@"Records"]);
+        return page;
+    }
+    return nil;
+}
+
 - (id)responseObjectForResponse:(NSHTTPURLResponse *)response
                 originalRequest:(NSURLRequest *)originalRequest
                  currentRequest:(NSURLRequest *)currentRequest
                            data:(id)data
                           error:(NSError *__autoreleasing *)error {
+    AWSCognitoSyncMetrics *metrics = self.metrics;
+    if (!metrics) {
+        return [self decodedObjectForResponse:response originalRequest:originalRequest currentRequest:currentRequest data:data error:error];
+    }
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    id responseObject = [self decodedObjectForResponse:response originalRequest:originalRequest currentRequest:currentRequest data:data error:error];
+    metrics.deserializeDuration += CFAbsoluteTimeGetCurrent() - start;
+    metrics.deserializedAttempts++;
+    metrics.responseBytes = [data isKindOfClass:[NSData class]] ? [data length] : 0;
+    metrics.statusCode = response.statusCode;
+    return responseObject;
+}
+
+- (id)decodedObjectForResponse:(NSHTTPURLResponse *)response
+               originalRequest:(NSURLRequest *)originalRequest
+                currentRequest:(NSURLRequest *)currentRequest
+                          data:(id)data
+                         error:(NSError *__autoreleasing *)error {
     id responseObject = [super responseObjectForResponse:response
                                          originalRequest:originalRequest
                                           currentRequest:currentRequest
@@ -96,7 +246,10 @@ static NSDictionary *errorCodeDictionary = nil;
     }
 
     if (!*error && [responseObject isKindOfClass:[NSDictionary class]]) {
-        if (self.outputClass) {
+        id recordPage = [self recordPageForJSONDictionary:responseObject];
+        if (recordPage) {
+            responseObject = recordPage;
+        } else if (self.outputClass) {
             responseObject = [AWSMTLJSONAdapter modelOfClass:self.outputClass
                                           fromJSONDictionary:responseObject
                                                        error:error];
@@ -142,6 +295,53 @@ static NSDictionary *errorCodeDictionary = nil;
 
 @end
 
+@interface AWSCognitoSyncRequestCompressor : NSObject <AWSNetworkingRequestInterceptor>
+
+@property (atomic, assign) NSUInteger threshold;
+
+@end
+
+@implementation AWSCognitoSyncRequestCompressor
+
++ (NSData *)gzipData:(NSData *)data {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 added to the window bits asks for a gzip header instead of a zlib one
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nil;
+    }
+
+    NSMutableData *compressed = [NSMutableData dataWithLength:deflateBound(&stream, (uLong)[data length])];
+    stream.next_in = (Bytef *)[data bytes];
+    stream.avail_in = (uInt)[data length];
+    stream.next_out = [compressed mutableBytes];
+    stream.avail_out = (uInt)[compressed length];
+    int status = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        return nil;
+    }
+
+    [compressed setLength:stream.total_out];
+    return compressed;
+}
+
+- (AWSTask *)interceptRequest:(NSMutableURLRequest *)request {
+    NSUInteger threshold = self.threshold;
+    NSData *body = request.HTTPBody;
+    // runs ahead of the signer, which then signs the compressed body
+    if (threshold > 0 && [body length] >= threshold && ![request valueForHTTPHeaderField:@"Content-Encoding"]) {
+        NSData *compressed = [AWSCognitoSyncRequestCompressor gzipData:body];
+        if (compressed && [compressed length] < [body length]) {
+            request.HTTPBody = compressed;
+            [request setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+        }
+    }
+    return [AWSTask taskWithResult:nil];
+}
+
+@end
+
 @interface AWSRequest()
 
 @property (nonatomic, strong) AWSNetworkingRequest *internalRequest;
@@ -152,6 +352,7 @@ static NSDictionary *errorCodeDictionary = nil;
 
 @property (nonatomic, strong) AWSNetworking *networking;
 @property (nonatomic, strong) AWSServiceConfiguration *configuration;
+@property (nonatomic, strong) AWSCognitoSyncRequestCompressor *requestCompressor;
 
 @end
 
@@ -164,6 +365,16 @@ static NSDictionary *errorCodeDictionary = nil;
 @implementation AWSCognitoSync
 
 static AWSSynchronizedMutableDictionary *_serviceClients = nil;
+// the serializers hold no per-request state, so one pair per operation serves every client
+static AWSSynchronizedMutableDictionary *_requestSerializers = nil;
+static AWSSynchronizedMutableDictionary *_responseSerializers = nil;
+
++ (void)initialize {
+    if (self == [AWSCognitoSync class]) {
+        _requestSerializers = [AWSSynchronizedMutableDictionary new];
+        _responseSerializers = [AWSSynchronizedMutableDictionary new];
+    }
+}
 
 + (instancetype)defaultCognitoSync {
     if (![AWSServiceManager defaultServiceManager].defaultServiceConfiguration) {
@@ -220,7 +431,8 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
         AWSSignatureV4Signer *signer = [[AWSSignatureV4Signer alloc] initWithCredentialsProvider:_configuration.credentialsProvider
                                                                                         endpoint:_configuration.endpoint];
         AWSNetworkingRequestInterceptor *baseInterceptor = [[AWSNetworkingRequestInterceptor alloc] initWithUserAgent:_configuration.userAgent];
-        _configuration.requestInterceptors = @[baseInterceptor, signer];
+        _requestCompressor = [AWSCognitoSyncRequestCompressor new];
+        _configuration.requestInterceptors = @[baseInterceptor, _requestCompressor, signer];
 
         _configuration.baseURL = _configuration.endpoint.URL;
         _configuration.requestSerializer = [AWSJSONRequestSerializer new];
@@ -229,11 +441,24 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
                                    @"Content-Type" : @"application/x-amz-json-1.1"};
 
         _networking = [[AWSNetworking alloc] initWithConfiguration:_configuration];
+
+        // parse the service definition off the caller's thread, ahead of the first request
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [AWSCognitoSyncResources sharedInstance];
+        });
     }
 
     return self;
 }
 
+- (NSUInteger)requestCompressionThreshold {
+    return self.requestCompressor.threshold;
+}
+
+- (void)setRequestCompressionThreshold:(NSUInteger)requestCompressionThreshold {
+    self.requestCompressor.threshold = requestCompressionThreshold;
+}
+
 - (AWSTask *)invokeRequest:(AWSRequest *)request
                HTTPMethod:(AWSHTTPMethod)HTTPMethod
                 URLString:(NSString *) URLString
@@ -244,24 +469,57 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
         request = [AWSRequest new];
     }
 
+    id<AWSCognitoSyncMetricsDelegate> metricsDelegate = self.metricsDelegate;
+    AWSCognitoSyncMetrics *metrics = metricsDelegate ? [[AWSCognitoSyncMetrics alloc] initWithOperationName:operationName] : nil;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
     AWSNetworkingRequest *networkingRequest = request.internalRequest;
     if (request) {
         networkingRequest.parameters = [[AWSMTLJSONAdapter JSONDictionaryFromModel:request] aws_removeNullValues];
     } else {
         networkingRequest.parameters = @{};
     }
+    metrics.serializeDuration = CFAbsoluteTimeGetCurrent() - start;
 
 
     NSMutableDictionary *headers = [NSMutableDictionary new];
 
     networkingRequest.headers = headers;
     networkingRequest.HTTPMethod = HTTPMethod;
-    networkingRequest.requestSerializer = [[AWSJSONRequestSerializer alloc] initWithJSONDefinition:[[AWSCognitoSyncResources sharedInstance] JSONObject]
-                                                                                        actionName:operationName];
-    networkingRequest.responseSerializer = [[AWSCognitoSyncResponseSerializer alloc] initWithJSONDefinition:[[AWSCognitoSyncResources sharedInstance] JSONObject]
-                                                                                                     actionName:operationName
-                                                                                                    outputClass:outputClass];
-    return [self.networking sendRequest:networkingRequest];
+    // metrics are recorded by serializers of the call's own, the shared ones stay untouched
+    AWSCognitoSyncRequestSerializer *requestSerializer = metrics ? nil : [_requestSerializers objectForKey:operationName];
+    if (!requestSerializer) {
+        requestSerializer = [[AWSCognitoSyncRequestSerializer alloc] initWithJSONDefinition:[[AWSCognitoSyncResources sharedInstance] JSONObject]
+                                                                                 actionName:operationName];
+        if (metrics) {
+            requestSerializer.metrics = metrics;
+        } else {
+            [_requestSerializers setObject:requestSerializer forKey:operationName];
+        }
+    }
+    AWSCognitoSyncResponseSerializer *responseSerializer = metrics ? nil : [_responseSerializers objectForKey:operationName];
+    if (!responseSerializer) {
+        responseSerializer = [[AWSCognitoSyncResponseSerializer alloc] initWithJSONDefinition:[[AWSCognitoSyncResources sharedInstance] JSONObject]
+                                                                                   actionName:operationName
+                                                                                  outputClass:outputClass];
+        if (metrics) {
+            responseSerializer.metrics = metrics;
+        } else {
+            [_responseSerializers setObject:responseSerializer forKey:operationName];
+        }
+    }
+    networkingRequest.requestSerializer = requestSerializer;
+    networkingRequest.responseSerializer = responseSerializer;
+
+    AWSTask *task = [self.networking sendRequest:networkingRequest];
+    if (!metrics) {
+        return task;
+    }
+    return [task continueWithBlock:^id(AWSTask *task) {
+        [metrics finishWithError:task.error totalDuration:CFAbsoluteTimeGetCurrent() - start];
+        [metricsDelegate cognitoSync:self didFinishCallWithMetrics:metrics];
+        return task;
+    }];
 }
 
 #pragma mark - Service method
@@ -741,4 +999,126 @@ static AWSSynchronizedMutableDictionary *_serviceClients = nil;
     }];
 }
 
-@end
\ No newline at end of file
+@end
+
+#pragma mark - Metrics collection
+
+static NSUInteger const AWSCognitoSyncDurationBuckets = 18;
+
+@interface AWSCognitoSyncOperationStatistics()
+
+@property (nonatomic, assign) NSUInteger calls;
+@property (nonatomic, assign) NSUInteger retries;
+@property (nonatomic, assign) unsigned long long requestBytes;
+@property (nonatomic, assign) unsigned long long responseBytes;
+@property (nonatomic, strong) NSMutableDictionary *mutableErrorCounts;
+@property (nonatomic, strong) NSMutableArray *mutableDurationHistogram;
+
+@end
+
+@implementation AWSCognitoSyncOperationStatistics
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _mutableErrorCounts = [NSMutableDictionary new];
+        _mutableDurationHistogram = [NSMutableArray arrayWithCapacity:AWSCognitoSyncDurationBuckets];
+        for (NSUInteger i = 0; i < AWSCognitoSyncDurationBuckets; i++) {
+            [_mutableDurationHistogram addObject:@0];
+        }
+    }
+    return self;
+}
+
+- (instancetype)snapshot {
+    AWSCognitoSyncOperationStatistics *snapshot = [AWSCognitoSyncOperationStatistics new];
+    snapshot.calls = self.calls;
+    snapshot.retries = self.retries;
+    snapshot.requestBytes = self.requestBytes;
+    snapshot.responseBytes = self.responseBytes;
+    snapshot.mutableErrorCounts = [self.mutableErrorCounts mutableCopy];
+    snapshot.mutableDurationHistogram = [self.mutableDurationHistogram mutableCopy];
+    return snapshot;
+}
+
+- (void)addMetrics:(AWSCognitoSyncMetrics *)metrics {
+    self.calls++;
+    self.retries += metrics.retries;
+    self.requestBytes += metrics.requestBytes;
+    self.responseBytes += metrics.responseBytes;
+    if (metrics.error) {
+        NSString *errorKey = [NSString stringWithFormat:@"%@:%ld", metrics.error.domain, (long)metrics.error.code];
+        self.mutableErrorCounts[errorKey] = @([self.mutableErrorCounts[errorKey] unsignedIntegerValue] + 1);
+    }
+
+    double milliseconds = metrics.totalDuration * 1000.0;
+    NSUInteger bucket = 0;
+    while (bucket < AWSCognitoSyncDurationBuckets - 1 && milliseconds >= (double)(1 << bucket)) {
+        bucket++;
+    }
+    self.mutableDurationHistogram[bucket] = @([self.mutableDurationHistogram[bucket] unsignedIntegerValue] + 1);
+}
+
+- (NSDictionary *)errorCounts {
+    return self.mutableErrorCounts;
+}
+
+- (NSArray *)durationHistogram {
+    return self.mutableDurationHistogram;
+}
+
+- (NSTimeInterval)durationPercentile:(double)percentile {
+    if (self.calls == 0) {
+        return 0;
+    }
+    NSUInteger rank = (NSUInteger)ceil(MIN(MAX(percentile, 0), 1) * self.calls);
+    NSUInteger seen = 0;
+    for (NSUInteger bucket = 0; bucket < AWSCognitoSyncDurationBuckets - 1; bucket++) {
+        seen += [self.mutableDurationHistogram[bucket] unsignedIntegerValue];
+        if (seen >= MAX(rank, 1)) {
+            return (1 << bucket) / 1000.0;
+        }
+    }
+    return (1 << (AWSCognitoSyncDurationBuckets - 2)) / 1000.0;
+}
+
+@end
+
+@interface AWSCognitoSyncMetricsCollector()
+
+@property (nonatomic, strong) NSMutableDictionary *operations;
+
+@end
+
+@implementation AWSCognitoSyncMetricsCollector
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _operations = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (void)cognitoSync:(AWSCognitoSync *)cognitoSync didFinishCallWithMetrics:(AWSCognitoSyncMetrics *)metrics {
+    @synchronized(self.operations) {
+        AWSCognitoSyncOperationStatistics *statistics = self.operations[metrics.operationName];
+        if (!statistics) {
+            statistics = [AWSCognitoSyncOperationStatistics new];
+            self.operations[metrics.operationName] = statistics;
+        }
+        [statistics addMetrics:metrics];
+    }
+}
+
+- (AWSCognitoSyncOperationStatistics *)statisticsForOperation:(NSString *)operationName {
+    @synchronized(self.operations) {
+        return [self.operations[operationName] snapshot];
+    }
+}
+
+- (void)reset {
+    @synchronized(self.operations) {
+        [self.operations removeAllObjects];
+    }
+}
+
+@end